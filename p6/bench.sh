@@ -0,0 +1,90 @@
+#!/bin/bash
+# Benchmark the regular program on synthetic input made by gencorpus.
+# Each pattern in the matrix is run against a corpus, reporting the
+# time, lines and megabytes per second and peak memory for the run.
+# Then a few patterns are profiled with the table engine, reporting
+# the time spent in each type of pattern.
+#
+# usage: ./bench.sh [megabytes] [flags]
+#   megabytes  size of each corpus (default 16).
+#   flags      extra options for every run, like -t or "-j 4".
+
+SIZE=${1:-16}
+FLAGS="$2"
+
+if [ ! -x regular ] || [ ! -x gencorpus ]; then
+  echo "**** Build regular and gencorpus first (make bench does this)"
+  exit 13
+fi
+
+DIR=$(mktemp -d)
+trap 'rm -rf $DIR' EXIT
+
+for KIND in random log pathological; do
+  ./gencorpus $KIND $SIZE > $DIR/$KIND.txt
+done
+
+printf "%-13s %-8s %-28s %9s %13s %9s %10s\n" corpus options pattern \
+       ms lines/s MB/s "peak KB"
+
+# Run one benchmark and print a line of results.
+#   $1  corpus kind.
+#   $2  extra options for this run.
+#   $3  pattern.
+bench() {
+  INPUT=$DIR/$1.txt
+  LINES=$(wc -l < $INPUT)
+  BYTES=$(stat -c %s $INPUT)
+
+  START=$(date +%s%N)
+  ./regular $FLAGS $2 -s "$3" $INPUT > /dev/null 2> $DIR/stats.txt
+  STATUS=$?
+  NS=$(( $(date +%s%N) - START ))
+
+  if [ $STATUS -ne 0 ]; then
+    echo "**** $1 '$3' failed with status $STATUS"
+    return
+  fi
+
+  PEAK=$(sed -n 's/^memory: \([0-9]*\) KB peak$/\1/p' $DIR/stats.txt)
+  awk -v kind="$1" -v opts="${2:--}" -v pat="$3" -v ns=$NS -v lines=$LINES \
+      -v bytes=$BYTES -v peak="$PEAK" 'BEGIN {
+    s = ns > 0 ? ns / 1e9 : 1e-9;
+    printf "%-13s %-8s %-28s %9.1f %13.0f %9.1f %10s\n", kind, opts, pat,
+           ns / 1e6, lines / s, bytes / s / 1048576, peak;
+  }'
+}
+
+bench random "" 'xyz'
+bench random "" '[0-9][a-z]+[0-9]'
+bench random "" 'q.u.i.c.k'
+bench random "" '(ab|cd|ef)+g'
+
+bench log "" 'ERROR'
+bench log "" 'disk [0-9]+% full'
+bench log "" 'timeout|retry|lock'
+bench log "" '^2024-0[1-6]-.*\[WARN\]'
+bench log -c 'timeout|retry|lock'
+bench log -o 'user [a-z]+'
+bench log --json 'cache|queue'
+
+bench pathological "" 'a*a*a*a*a*b'
+bench pathological "" '(a|aa)*b'
+bench pathological "" '(a*)*b'
+bench pathological "" 'a{20,}b'
+
+# Profile one pattern on the first megabyte of a corpus, and print the
+# time spent in each type of pattern.
+#   $1  corpus kind.
+#   $2  pattern.
+profile() {
+  head -c 1048576 $DIR/$1.txt > $DIR/sample.txt
+  echo
+  echo "$1 '$2'"
+  ./regular $FLAGS -t -p "$2" $DIR/sample.txt 2>&1 > /dev/null | sed '1,/^$/d'
+}
+
+profile random '[0-9][a-z]+[0-9]'
+profile log 'disk [0-9]+% full'
+profile log 'timeout|retry|lock'
+profile pathological '(a|aa)*b'
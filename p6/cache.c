@@ -0,0 +1,245 @@
+/**
+ * Component program that saves compiled automata to cache files and
+ * loads them back.  A cache file has a fixed-size header, then the
+ * source the automaton was compiled from and the literal string saved
+ * with it, padded to a multiple of 8 bytes, then the automaton's
+ * states as fixed-size records.  Files are read by mapping them into
+ * memory, so the state records can be checked and copied without
+ * parsing.  Numbers are stored in the machine's own byte order, since
+ * cache files are only meant to be used on the machine that wrote them.
+ *
+ * @file cache.c
+ * @author Jimmy Nguyen (jnguyen6)
+ */
+
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** Bytes at the start of every cache file. */
+#define CACHE_MAGIC "RGXC"
+
+/** Length of CACHE_MAGIC. */
+#define MAGIC_LEN 4
+
+/** State records start at a multiple of this many bytes. */
+#define ALIGNMENT 8
+
+/** Extension for cache file names. */
+#define CACHE_EXT ".rgc"
+
+/** Header at the start of a cache file. */
+typedef struct {
+  /** Identifies the file, CACHE_MAGIC. */
+  char magic[ MAGIC_LEN ];
+
+  /** Version of the file format, CACHE_VERSION. */
+  uint32_t version;
+
+  /** Hash code for the source. */
+  uint64_t hash;
+
+  /** Number of bytes in the source. */
+  uint32_t keyLength;
+
+  /** Number of bytes in the literal string. */
+  uint32_t literalLength;
+
+  /** Size of each state record, to catch files from another build. */
+  uint32_t stateSize;
+
+  /** Number of states. */
+  int32_t count;
+
+  /** Index of the start state. */
+  int32_t start;
+
+  /** Index of the match state for pattern 0. */
+  int32_t match;
+
+  /** Number of pattern IDs. */
+  int32_t ids;
+
+  /** Unused, keeps the header a multiple of 8 bytes. */
+  uint32_t padding;
+} CacheHeader;
+
+// Documented in the header.
+uint64_t cacheHash( char const *key )
+{
+  // 64-bit FNV-1a.
+  uint64_t h = 14695981039346656037ULL;
+  for ( int i = 0; key[ i ]; i++ )
+    h = ( h ^ (unsigned char) key[ i ] ) * 1099511628211ULL;
+  return h;
+}
+
+// Documented in the header.
+char *cachePath( char const *dir, char const *key )
+{
+  char name[ 2 * sizeof( uint64_t ) + sizeof( CACHE_EXT ) ];
+  sprintf( name, "%016llx%s", (unsigned long long) cacheHash( key ),
+           CACHE_EXT );
+
+  char *path = (char *) malloc( strlen( dir ) + strlen( name ) + 2 );
+  sprintf( path, "%s/%s", dir, name );
+  return path;
+}
+
+/** Return the number of bytes used by the source and literal, with
+    padding so the state records that follow are aligned.
+
+    @param head header of the cache file.
+    @return offset of the state records from the end of the header.
+*/
+static size_t stringsSize( CacheHeader const *head )
+{
+  size_t size = head->keyLength + head->literalLength;
+  return ( size + ALIGNMENT - 1 ) / ALIGNMENT * ALIGNMENT;
+}
+
+/** Report true if a state refers to another state that's in range.
+
+    @param target index of the state it refers to.
+    @param count number of states.
+    @param optional true if UNKNOWN (-1) is also allowed.
+    @return true if target is a valid reference.
+*/
+static bool validTarget( int target, int count, bool optional )
+{
+  return ( target >= 0 && target < count ) || ( optional && target == -1 );
+}
+
+/** Check that the states in a cache file make a sensible automaton,
+    so a damaged file can't make us read outside the state array.
+
+    @param head header of the cache file.
+    @param states state records from the file.
+    @return true if the states look right.
+*/
+static bool validStates( CacheHeader const *head, NfaState const *states )
+{
+  int count = head->count;
+  if ( count <= 0 || !validTarget( head->start, count, false )
+       || !validTarget( head->match, count, false )
+       || states[ head->match ].type != STATE_MATCH || head->ids <= 0 )
+    return false;
+
+  for ( int i = 0; i < count; i++ ) {
+    NfaState const *st = states + i;
+    if ( st->type == STATE_MATCH ) {
+      if ( st->id < 0 || st->id >= head->ids )
+        return false;
+    } else if ( st->type == STATE_SPLIT ) {
+      if ( !validTarget( st->out, count, false )
+           || !validTarget( st->out1, count, false ) )
+        return false;
+    } else if ( st->type == STATE_CHAR || st->type == STATE_BOL
+                || st->type == STATE_EOL || st->type == STATE_SAVE ) {
+      if ( !validTarget( st->out, count, false ) )
+        return false;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Documented in the header.
+Nfa *loadCompiled( char const *path, char const *key, char **literal )
+{
+  int fd = open( path, O_RDONLY );
+  if ( fd < 0 )
+    return NULL;
+
+  struct stat info;
+  if ( fstat( fd, &info ) != 0 || info.st_size < sizeof( CacheHeader ) ) {
+    close( fd );
+    return NULL;
+  }
+  size_t size = info.st_size;
+  char const *data = (char const *) mmap( NULL, size, PROT_READ, MAP_PRIVATE,
+                                          fd, 0 );
+  close( fd );
+  if ( data == MAP_FAILED )
+    return NULL;
+
+  // Make sure the file is for this version and exactly this source.
+  CacheHeader const *head = (CacheHeader const *) data;
+  char const *strings = data + sizeof( CacheHeader );
+  size_t keyLength = strlen( key );
+  Nfa *nfa = NULL;
+  if ( memcmp( head->magic, CACHE_MAGIC, MAGIC_LEN ) == 0
+       && head->version == CACHE_VERSION
+       && head->stateSize == sizeof( NfaState )
+       && head->hash == cacheHash( key ) && head->keyLength == keyLength
+       && head->count > 0
+       && size == sizeof( CacheHeader ) + stringsSize( head )
+                  + (size_t) head->count * sizeof( NfaState )
+       && memcmp( strings, key, keyLength ) == 0 ) {
+    NfaState const *states =
+      (NfaState const *) ( strings + stringsSize( head ) );
+    if ( validStates( head, states ) ) {
+      // Use the mapped records as an automaton long enough to copy it.
+      Nfa mapped = { (NfaState *) states, head->count, head->count,
+                     head->start, head->match, head->ids, NULL, NULL };
+      nfa = copyNfa( &mapped );
+
+      *literal = (char *) malloc( head->literalLength + 1 );
+      memcpy( *literal, strings + keyLength, head->literalLength );
+      ( *literal )[ head->literalLength ] = '\0';
+    }
+  }
+
+  munmap( (void *) data, size );
+  return nfa;
+}
+
+// Documented in the header.
+bool saveCompiled( char const *path, char const *key, Nfa const *nfa,
+                   char const *literal )
+{
+  CacheHeader head;
+  memset( &head, 0, sizeof( head ) );
+  memcpy( head.magic, CACHE_MAGIC, MAGIC_LEN );
+  head.version = CACHE_VERSION;
+  head.hash = cacheHash( key );
+  head.keyLength = strlen( key );
+  head.literalLength = strlen( literal );
+  head.stateSize = sizeof( NfaState );
+  head.count = nfa->count;
+  head.start = nfa->start;
+  head.match = nfa->match;
+  head.ids = nfa->ids;
+
+  // Write to a name only this process uses, then move it into place.
+  char *temp = (char *) malloc( strlen( path ) + 32 );
+  sprintf( temp, "%s.%ld.tmp", path, (long) getpid() );
+  FILE *fp = fopen( temp, "wb" );
+  if ( !fp ) {
+    free( temp );
+    return false;
+  }
+
+  char padding[ ALIGNMENT ] = { 0 };
+  size_t pad = stringsSize( &head ) - head.keyLength - head.literalLength;
+  bool ok = fwrite( &head, sizeof( head ), 1, fp ) == 1
+    && fwrite( key, 1, head.keyLength, fp ) == head.keyLength
+    && fwrite( literal, 1, head.literalLength, fp ) == head.literalLength
+    && fwrite( padding, 1, pad, fp ) == pad
+    && fwrite( nfa->states, sizeof( NfaState ), nfa->count, fp )
+       == nfa->count;
+  ok = fclose( fp ) == 0 && ok;
+
+  if ( ok )
+    ok = rename( temp, path ) == 0;
+  if ( !ok )
+    remove( temp );
+  free( temp );
+  return ok;
+}
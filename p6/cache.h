@@ -0,0 +1,64 @@
+/**
+ * Header file for the cache.c component, which saves compiled
+ * automata in files and loads them back, so a pattern that's used
+ * over and over doesn't have to be parsed and compiled every time.
+ * Each file is named for a hash of the source it was compiled from
+ * and also stores that source, so a file is only used for exactly
+ * the same source.  The file format is versioned, and files from
+ * another version (or that don't look right) are ignored.
+ *
+ * @file cache.h
+ * @author Jimmy Nguyen (jnguyen6)
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "nfa.h"
+
+/** Version number for the cache file format.  This should change
+    whenever the format or the meaning of the automaton states does. */
+#define CACHE_VERSION 1
+
+/** Compute the hash code used to name the cache file for some source.
+
+    @param key the source the automaton is compiled from.
+    @return hash code for key.
+*/
+uint64_t cacheHash( char const *key );
+
+/** Make the name of the cache file for the given source.
+
+    @param dir directory where cache files are kept.
+    @param key the source the automaton is compiled from.
+    @return the dynamically allocated file name.
+*/
+char *cachePath( char const *dir, char const *key );
+
+/** Load a compiled automaton from a cache file.
+
+    @param path name of the cache file.
+    @param key the source the automaton should be compiled from.
+    @param literal returns a dynamically allocated copy of the literal
+                   string saved with the automaton.
+    @return the automaton, or NULL if there's no usable file for key.
+*/
+Nfa *loadCompiled( char const *path, char const *key, char **literal );
+
+/** Save a compiled automaton to a cache file.  The file is written
+    under a temporary name and then renamed, so another process never
+    sees a partly written file.
+
+    @param path name of the cache file.
+    @param key the source the automaton was compiled from.
+    @param nfa the automaton to save.
+    @param literal a string every match must contain, to save with the
+                   automaton.  This can be empty.
+    @return true if the file was written.
+*/
+bool saveCompiled( char const *path, char const *key, Nfa const *nfa,
+                   char const *literal );
+
+#endif
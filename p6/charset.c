@@ -0,0 +1,308 @@
+/**
+ * Component program that implements sets of byte values and the
+ * kernels that find members of a set in a string.  On x86 processors,
+ * single characters are found with SSE2 (always available on x86-64)
+ * or AVX2 compares, and sets are found with an AVX2 nibble lookup,
+ * where each byte's low four bits pick an entry from a 16-entry table
+ * and its high four bits pick a bit in that entry.  The AVX2 versions
+ * are only used if the processor reports support for them at runtime.
+ *
+ * @file charset.c
+ * @author Jimmy Nguyen (jnguyen6)
+ */
+
+#include "charset.h"
+
+#if defined( __x86_64__ )
+#include <immintrin.h>
+
+/** True if this build has the x86 vector kernels. */
+#define HAVE_X86_KERNELS 1
+#endif
+
+/** Number of bits in each word of a result. */
+#define WORD_BITS 64
+
+/** Lowercase form of byte value c, if it's an ASCII capital letter. */
+#define LOWER( c ) ( (c) >= 'A' && (c) <= 'Z' ? (c) - 'A' + 'a' : (c) )
+
+/** Lowercase forms of four byte values, starting at c. */
+#define LOWER4( c ) LOWER( c ), LOWER( c + 1 ), LOWER( c + 2 ), LOWER( c + 3 )
+
+/** Lowercase forms of sixteen byte values, starting at c. */
+#define LOWER16( c ) LOWER4( c ), LOWER4( c + 4 ), LOWER4( c + 8 ), \
+    LOWER4( c + 12 )
+
+/** Lowercase forms of sixty-four byte values, starting at c. */
+#define LOWER64( c ) LOWER16( c ), LOWER16( c + 16 ), LOWER16( c + 32 ), \
+    LOWER16( c + 48 )
+
+/** Lowercase form of every byte value, used to fold strings one lookup
+    per character. */
+static unsigned char const lowerCase[ CSET_WORDS * CSET_WORD_BITS ] = {
+  LOWER64( 0 ), LOWER64( 64 ), LOWER64( 128 ), LOWER64( 192 )
+};
+
+// Documented in the header.
+void csetClear( CharSet *set )
+{
+  for ( int i = 0; i < CSET_WORDS; i++ )
+    set->bits[ i ] = 0;
+}
+
+// Documented in the header.
+void csetAdd( CharSet *set, unsigned char c )
+{
+  set->bits[ c / CSET_WORD_BITS ] |= (uint64_t) 1 << ( c % CSET_WORD_BITS );
+}
+
+// Documented in the header.
+void csetRemove( CharSet *set, unsigned char c )
+{
+  set->bits[ c / CSET_WORD_BITS ] &=
+    ~( (uint64_t) 1 << ( c % CSET_WORD_BITS ) );
+}
+
+// Documented in the header.
+void csetFold( CharSet *set )
+{
+  for ( int c = 'a'; c <= 'z'; c++ ) {
+    int upper = c - 'a' + 'A';
+    if ( CSET_HAS( set, c ) || CSET_HAS( set, upper ) ) {
+      csetAdd( set, c );
+      csetAdd( set, upper );
+    }
+  }
+}
+
+// Documented in the header.
+int csetCount( CharSet const *set )
+{
+  int count = 0;
+  for ( int i = 0; i < CSET_WORDS; i++ )
+    count += __builtin_popcountll( set->bits[ i ] );
+  return count;
+}
+
+/** Fill in result bits one character at a time, starting at the given
+    position, which must be a multiple of 64.
+
+    @param set set of characters to look for.
+    @param str string to search.
+    @param start first position to check.
+    @param len length of the string.
+    @param bits result bits for the whole string.
+*/
+static void findInSetScalar( CharSet const *set, char const *str, int start,
+                             int len, uint64_t *bits )
+{
+  for ( int w = start / WORD_BITS; w * WORD_BITS < len; w++ ) {
+    uint64_t word = 0;
+    int end = len - w * WORD_BITS < WORD_BITS ? len - w * WORD_BITS : WORD_BITS;
+    for ( int i = 0; i < end; i++ ) {
+      unsigned char c = str[ w * WORD_BITS + i ];
+      if ( CSET_HAS( set, c ) )
+        word |= (uint64_t) 1 << i;
+    }
+    bits[ w ] = word;
+  }
+}
+
+#ifdef HAVE_X86_KERNELS
+
+/** Fold a string to lowercase 16 bytes at a time with SSE2.  Capital
+    letters are found with a signed compare after shifting 'A' down to
+    the smallest signed byte, then get the lowercase bit or'ed in.  Any
+    partial block at the end of the string is left for the caller.
+
+    @param str string to fold.
+    @param len length of the string.
+    @param dest returns the folded string.
+    @return number of characters folded, a multiple of 16.
+*/
+static int foldStringSSE2( char const *str, int len, char *dest )
+{
+  __m128i shift = _mm_set1_epi8( (char) ( -128 - 'A' ) );
+  __m128i limit = _mm_set1_epi8( (char) ( -128 + 'Z' - 'A' + 1 ) );
+  __m128i caseBit = _mm_set1_epi8( 'a' - 'A' );
+  int pos = 0;
+  for ( ; pos + 16 <= len; pos += 16 ) {
+    __m128i block = _mm_loadu_si128( (__m128i const *) ( str + pos ) );
+    __m128i upper = _mm_cmplt_epi8( _mm_add_epi8( block, shift ), limit );
+    block = _mm_or_si128( block, _mm_and_si128( upper, caseBit ) );
+    _mm_storeu_si128( (__m128i *) ( dest + pos ), block );
+  }
+  return pos;
+}
+
+/** Find a single character 16 bytes at a time with SSE2.  Any partial
+    word at the end of the string is left for the caller.
+
+    @param c character to look for.
+    @param str string to search.
+    @param len length of the string.
+    @param bits result bits for the whole string.
+    @return number of positions checked, a multiple of 64.
+*/
+static int findSymbolSSE2( char c, char const *str, int len, uint64_t *bits )
+{
+  __m128i target = _mm_set1_epi8( c );
+  int pos = 0;
+  for ( ; pos + WORD_BITS <= len; pos += WORD_BITS ) {
+    uint64_t word = 0;
+    for ( int i = 0; i < WORD_BITS; i += 16 ) {
+      __m128i block = _mm_loadu_si128( (__m128i const *) ( str + pos + i ) );
+      uint64_t mask = (unsigned) _mm_movemask_epi8( _mm_cmpeq_epi8( block,
+                                                                    target ) );
+      word |= mask << i;
+    }
+    bits[ pos / WORD_BITS ] = word;
+  }
+  return pos;
+}
+
+/** Find a single character 32 bytes at a time with AVX2.  Any partial
+    word at the end of the string is left for the caller.
+
+    @param c character to look for.
+    @param str string to search.
+    @param len length of the string.
+    @param bits result bits for the whole string.
+    @return number of positions checked, a multiple of 64.
+*/
+__attribute__(( target( "avx2" ) ))
+static int findSymbolAVX2( char c, char const *str, int len, uint64_t *bits )
+{
+  __m256i target = _mm256_set1_epi8( c );
+  int pos = 0;
+  for ( ; pos + WORD_BITS <= len; pos += WORD_BITS ) {
+    __m256i lo = _mm256_loadu_si256( (__m256i const *) ( str + pos ) );
+    __m256i hi = _mm256_loadu_si256( (__m256i const *) ( str + pos + 32 ) );
+    uint64_t loMask = (unsigned) _mm256_movemask_epi8( _mm256_cmpeq_epi8( lo,
+                                                                      target ) );
+    uint64_t hiMask = (unsigned) _mm256_movemask_epi8( _mm256_cmpeq_epi8( hi,
+                                                                      target ) );
+    bits[ pos / WORD_BITS ] = loMask | hiMask << 32;
+  }
+  return pos;
+}
+
+/** Find members of a set among 32 bytes with AVX2, using a nibble
+    lookup.  Entry n of lowTable has bit h set if the value with low
+    nibble n and high nibble h (0 - 7) is in the set, and highTable
+    does the same for high nibbles 8 - 15.
+
+    @param block 32 bytes of input.
+    @param lowTable lookup table for values below 128, in both lanes.
+    @param highTable lookup table for values 128 and up, in both lanes.
+    @return a bit for each byte that's in the set.
+*/
+__attribute__(( target( "avx2" ) ))
+static uint64_t classifyAVX2( __m256i block, __m256i lowTable,
+                              __m256i highTable )
+{
+  __m256i nibbleMask = _mm256_set1_epi8( 0x0F );
+  __m256i bitForHigh = _mm256_setr_epi8( 1, 2, 4, 8, 16, 32, 64, -128,
+                                         1, 2, 4, 8, 16, 32, 64, -128,
+                                         1, 2, 4, 8, 16, 32, 64, -128,
+                                         1, 2, 4, 8, 16, 32, 64, -128 );
+
+  __m256i low = _mm256_and_si256( block, nibbleMask );
+  __m256i high = _mm256_and_si256( _mm256_srli_epi16( block, 4 ),
+                                   _mm256_set1_epi8( 0x07 ) );
+
+  // Bytes with their top bit set use the second table.
+  __m256i entry = _mm256_blendv_epi8( _mm256_shuffle_epi8( lowTable, low ),
+                                      _mm256_shuffle_epi8( highTable, low ),
+                                      block );
+  __m256i hit = _mm256_and_si256( entry,
+                                  _mm256_shuffle_epi8( bitForHigh, high ) );
+  __m256i miss = _mm256_cmpeq_epi8( hit, _mm256_setzero_si256() );
+  return ~(unsigned) _mm256_movemask_epi8( miss ) & 0xFFFFFFFFu;
+}
+
+/** Find members of a set 64 bytes at a time with AVX2.  Any partial
+    word at the end of the string is left for the caller.
+
+    @param set set of characters to look for.
+    @param str string to search.
+    @param len length of the string.
+    @param bits result bits for the whole string.
+    @return number of positions checked, a multiple of 64.
+*/
+__attribute__(( target( "avx2" ) ))
+static int findInSetAVX2( CharSet const *set, char const *str, int len,
+                          uint64_t *bits )
+{
+  char low[ 16 ] = { 0 };
+  char high[ 16 ] = { 0 };
+  for ( int c = 0; c < CSET_WORDS * CSET_WORD_BITS; c++ )
+    if ( CSET_HAS( set, c ) ) {
+      if ( c < 128 )
+        low[ c & 0x0F ] |= 1 << ( c >> 4 );
+      else
+        high[ c & 0x0F ] |= 1 << ( ( c >> 4 ) - 8 );
+    }
+
+  __m128i low128 = _mm_loadu_si128( (__m128i const *) low );
+  __m128i high128 = _mm_loadu_si128( (__m128i const *) high );
+  __m256i lowTable = _mm256_broadcastsi128_si256( low128 );
+  __m256i highTable = _mm256_broadcastsi128_si256( high128 );
+
+  int pos = 0;
+  for ( ; pos + WORD_BITS <= len; pos += WORD_BITS ) {
+    __m256i lo = _mm256_loadu_si256( (__m256i const *) ( str + pos ) );
+    __m256i hi = _mm256_loadu_si256( (__m256i const *) ( str + pos + 32 ) );
+    bits[ pos / WORD_BITS ] = classifyAVX2( lo, lowTable, highTable )
+      | classifyAVX2( hi, lowTable, highTable ) << 32;
+  }
+  return pos;
+}
+
+#endif
+
+// Documented in the header.
+void findSymbol( char c, char const *str, int len, uint64_t *bits )
+{
+  int pos = 0;
+#ifdef HAVE_X86_KERNELS
+  if ( __builtin_cpu_supports( "avx2" ) )
+    pos = findSymbolAVX2( c, str, len, bits );
+  else
+    pos = findSymbolSSE2( c, str, len, bits );
+#endif
+
+  CharSet set;
+  csetClear( &set );
+  csetAdd( &set, c );
+  findInSetScalar( &set, str, pos, len, bits );
+}
+
+// Documented in the header.
+void findInSet( CharSet const *set, char const *str, int len,
+                uint64_t *bits )
+{
+  int pos = 0;
+#ifdef HAVE_X86_KERNELS
+  if ( __builtin_cpu_supports( "avx2" ) )
+    pos = findInSetAVX2( set, str, len, bits );
+#endif
+  findInSetScalar( set, str, pos, len, bits );
+}
+
+// Documented in the header.
+char foldCase( char c )
+{
+  return lowerCase[ (unsigned char) c ];
+}
+
+// Documented in the header.
+void foldString( char const *str, int len, char *dest )
+{
+  int i = 0;
+#ifdef HAVE_X86_KERNELS
+  i = foldStringSSE2( str, len, dest );
+#endif
+  for ( ; i < len; i++ )
+    dest[ i ] = lowerCase[ (unsigned char) str[ i ] ];
+}
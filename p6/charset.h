@@ -0,0 +1,113 @@
+/**
+ * Header file for the charset.c component, which provides a set of
+ * byte values stored as a 256-bit membership bitmap, and kernels that
+ * find every position in a string holding a member of a set.  The
+ * kernels use SSE2 or AVX2 instructions when the processor supports
+ * them, chosen at runtime, and a scalar loop otherwise.  It also
+ * provides a lookup table for folding ASCII letters to lowercase.
+ *
+ * @file charset.h
+ * @author Jimmy Nguyen (jnguyen6)
+ */
+
+#ifndef CHARSET_H
+#define CHARSET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Number of 64-bit words needed to hold one bit for every byte value. */
+#define CSET_WORDS 4
+
+/** Number of bits in each word of a CharSet. */
+#define CSET_WORD_BITS 64
+
+/** Evaluates to true if the given CharSet contains byte value c. */
+#define CSET_HAS( set, c ) \
+  ( ( ( set )->bits[ ( c ) / CSET_WORD_BITS ] >> ( ( c ) % CSET_WORD_BITS ) ) & 1 )
+
+/** A set of byte values, one bit for each of the 256 possible values. */
+typedef struct {
+  /** Membership bits, bit c % 64 of word c / 64 is set for each value c. */
+  uint64_t bits[ CSET_WORDS ];
+} CharSet;
+
+/** Clear all the values in the given set.
+
+    @param set set to clear.
+*/
+void csetClear( CharSet *set );
+
+/** Add the given byte value to the set.
+
+    @param set set to add to.
+    @param c value to add.
+*/
+void csetAdd( CharSet *set, unsigned char c );
+
+/** Remove the given byte value from the set.
+
+    @param set set to remove from.
+    @param c value to remove.
+*/
+void csetRemove( CharSet *set, unsigned char c );
+
+/** Add the other case of every ASCII letter in the set, so the set
+    doesn't care about case.
+
+    @param set set to fold.
+*/
+void csetFold( CharSet *set );
+
+/** Return the given character folded to lowercase, if it's an ASCII
+    letter.
+
+    @param c character to fold.
+    @return lowercase form of c, or c itself.
+*/
+char foldCase( char c );
+
+/** Fold a string to lowercase, one table lookup for each character.
+    Only ASCII letters change, so the folded string has the same length
+    and every match in it is at the same place as in the original.
+
+    @param str string to fold.
+    @param len length of the string.
+    @param dest returns the folded string, without a null terminator.
+                This can be the same as str.
+*/
+void foldString( char const *str, int len, char *dest );
+
+/** Return the number of values in the given set.
+
+    @param set set to count.
+    @return number of values in the set.
+*/
+int csetCount( CharSet const *set );
+
+/** Find every position in the string that holds the given character.
+    Bit i % 64 of word i / 64 in the result is set if str[ i ] is c.
+    All (len + 63) / 64 words of the result are overwritten, with bits
+    past the end of the string cleared.
+
+    @param c character to look for.
+    @param str string to search.
+    @param len length of the string.
+    @param bits returns a bit for each position in the string.
+*/
+void findSymbol( char c, char const *str, int len, uint64_t *bits );
+
+/** Find every position in the string that holds a member of the given
+    set.  Bit i % 64 of word i / 64 in the result is set if str[ i ] is
+    in the set.  All (len + 63) / 64 words of the result are
+    overwritten, with bits past the end of the string cleared.
+
+    @param set set of characters to look for.
+    @param str string to search.
+    @param len length of the string.
+    @param bits returns a bit for each position in the string.
+*/
+void findInSet( CharSet const *set, char const *str, int len,
+                uint64_t *bits );
+
+#endif
@@ -1,6 +1,10 @@
 #!/bin/bash
 FAIL=0
 
+# Optional flags passed to every run of the program, like -t to
+# check the match-table engine instead of the automaton.
+FLAGS="$1"
+
 # Make a fresh copy of the target program
 make clean
 make
@@ -64,12 +68,49 @@ checkResults() {
 runTest() {
   rm -f output.txt stderr.txt
 
-  echo "Test $1: ./regular '$2' input-$1.txt > output.txt 2> stderr.txt"
-  ./regular "$2" input-$1.txt > output.txt 2> stderr.txt
+  echo "Test $1: ./regular $FLAGS '$2' input-$1.txt > output.txt 2> stderr.txt"
+  ./regular $FLAGS "$2" input-$1.txt > output.txt 2> stderr.txt
+  STATUS=$?
+
+  checkResults "$1" "$3"
+}
+
+# Test the program with a pattern read from pattern-N.txt (for patterns
+# too long to show), failing if it takes longer than the given number
+# of seconds.
+runTimedTest() {
+  rm -f output.txt stderr.txt
+
+  echo "Test $1: ./regular $FLAGS \"\$(cat pattern-$1.txt)\" input-$1.txt > output.txt 2> stderr.txt"
+  START=$(date +%s%N)
+  timeout $2 ./regular $FLAGS "$(cat pattern-$1.txt)" input-$1.txt > output.txt 2> stderr.txt
   STATUS=$?
+  echo "Test $1 took $(( ( $(date +%s%N) - START ) / 1000000 )) ms (limit $2 s)"
 
   checkResults "$1" "$3"
 }
+
+# Test the program with a file of patterns, plus any extra options.
+runPatternFileTest() {
+  rm -f output.txt stderr.txt
+
+  echo "Test $1: ./regular $FLAGS $2 -f patterns-$1.txt input-$1.txt > output.txt 2> stderr.txt"
+  ./regular $FLAGS $2 -f patterns-$1.txt input-$1.txt > output.txt 2> stderr.txt
+  STATUS=$?
+
+  checkResults "$1" "$3"
+}
+
+# Test the program with an extra option before the pattern.
+runOptionTest() {
+  rm -f output.txt stderr.txt
+
+  echo "Test $1: ./regular $FLAGS $2 '$3' input-$1.txt > output.txt 2> stderr.txt"
+  ./regular $FLAGS $2 "$3" input-$1.txt > output.txt 2> stderr.txt
+  STATUS=$?
+
+  checkResults "$1" "$4"
+}
 echo
 echo "Tests for extended character class syntax."
 
@@ -90,6 +131,115 @@ runTest 41 '^[0123456789]{,5}$' 0
 runTest 42 '^[0123456789]{3,}$' 0
 runTest 43 '^a{7,6}$' 1
 runTest 44 '^a{abc,xyz}$' 1
+runTest 45 '^a{0,500}$' 0
+runTest 46 '(ab){2,3}' 0
+runTest 47 'a{200,300}' 0
+runTest 48 'a{1,2000}' 1
+
+echo
+echo "Tests for counting and listing matching lines."
+runOptionTest 50 -c 'ab+c' 0
+runOptionTest 51 -c 'xyz' 0
+runOptionTest 52 -l '^$' 0
+runOptionTest 53 -l 'q' 0
+
+echo
+echo "Tests for printing matches and byte offsets."
+runOptionTest 54 -o 'b+c?' 0
+runOptionTest 55 -b 'b+c|^$' 0
+runOptionTest 56 '-o -b' 'a.' 0
+
+echo
+echo "Tests for matching a file of patterns."
+runPatternFileTest 57 '' 0
+runPatternFileTest 58 -c 0
+runPatternFileTest 59 '' 1
+
+echo
+echo "Tests for caching compiled patterns (each runs twice, to save and load)."
+CACHE_DIR=$(mktemp -d)
+runOptionTest 60 "-C $CACHE_DIR" 'disk [0-9]+%' 0
+runOptionTest 60 "-C $CACHE_DIR" 'disk [0-9]+%' 0
+runPatternFileTest 61 "-C $CACHE_DIR" 0
+runPatternFileTest 61 "-C $CACHE_DIR" 0
+rm -rf $CACHE_DIR
+
+echo
+echo "Tests for patterns the optimizer rewrites."
+runTest 62 'cat|car|dog|do' 0
+runTest 63 'x(ab|ac|a)y' 0
+runTest 64 '^a**+b' 0
+
+echo
+echo "Tests for alternation matching either alternative."
+runTest 65 'cat|dog' 0
+runTimedTest 66 5 0
+
+echo
+echo "Tests for nested and machine-generated patterns."
+runTimedTest 67 5 0
+runTest 68 '(a(b|c)+d)e' 0
+runTest 69 '((ab)|c' 1
+
+echo
+echo "Tests for machine-readable output."
+runOptionTest 70 --json 'b+c|^$' 0
+runPatternFileTest 71 --json 0
+runOptionTest 72 --binary 'a.' 0
+
+echo
+echo "Tests for turning off highlighting."
+runOptionTest 73 '--color=never -b' 'b+c|^$' 0
+runOptionTest 74 --color=auto 'b+c?' 0
+
+echo
+echo "Tests for extracting fields with capture groups."
+runOptionTest 75 -e 'user=([a-z]+)( latency=([0-9]+)ms)?' 0
+runOptionTest 76 '--extract -b' 'latency=[0-9]+' 0
+runOptionTest 77 -e '((a)|b)+' 0
+
+echo
+echo "Tests for matching the input as a stream."
+runOptionTest 78 --stream 'a[^x]*b' 0
+runOptionTest 79 '--stream -b' 'b$|^x+' 0
+
+echo
+echo "Tests for ignoring case."
+runOptionTest 80 -i 'err?or|[^a-z ]b' 0
+runOptionTest 81 '-i -o' '[A-C]x|^[^a]+$' 0
+
+echo
+echo "Tests for anchored patterns."
+runOptionTest 82 '-b -o' '[0-9]+$' 0
+runTest 83 '^(ab|a)c|^$' 0
+
+echo
+echo "Tests for a line too long for match tables."
+LONG=$(mktemp)
+{ head -c 400000 /dev/zero | tr '\0' x; echo ab; } > $LONG
+
+rm -f output.txt stderr.txt
+echo "Test 84: ./regular -c 'ab' <400000-character line> > output.txt 2> stderr.txt"
+./regular -c 'ab' $LONG > output.txt 2> stderr.txt
+STATUS=$?
+checkResults 84 0
+
+rm -f output.txt stderr.txt
+echo "Test 85: ./regular -t -c 'ab' <400000-character line> > output.txt 2> stderr.txt"
+./regular -t -c 'ab' $LONG > output.txt 2> stderr.txt
+STATUS=$?
+checkResults 85 1
+rm -f $LONG
+
+echo
+echo "Tests for a long machine-generated pattern."
+DOTS=$(head -c 120000 /dev/zero | tr '\0' .)
+
+rm -f output.txt stderr.txt
+echo "Test 86: ./regular $FLAGS '<120000 dots>|^[0-9]+\$' input-86.txt > output.txt 2> stderr.txt"
+./regular $FLAGS "$DOTS|^[0-9]+\$" input-86.txt > output.txt 2> stderr.txt
+STATUS=$?
+checkResults 86 0
 
 if [ $FAIL -ne 0 ]; then
   echo "FAILING TESTS!"
@@ -0,0 +1,140 @@
+/**
+ * Program that writes a synthetic input file for benchmarking regular.
+ * It can write random printable text, lines that look like a server
+ * log, or long runs of the same character that are slow for patterns
+ * like a*a*a*b.  The same kind, size and seed always give the same file.
+ *
+ * @file gencorpus.c
+ * @author Jimmy Nguyen (jnguyen6)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Number of bytes in a megabyte. */
+#define MEGABYTE ( 1024 * 1024 )
+
+/** Longest line written for random text. */
+#define MAX_RANDOM_LINE 120
+
+/** Length of each line for pathological input. */
+#define PATHOLOGICAL_LINE 200
+
+/** Seed used if there isn't one on the command line. */
+#define DEFAULT_SEED 1
+
+/** Words used for log messages. */
+static char const *words[] = {
+  "connection", "request", "user", "disk", "cache", "timeout", "socket",
+  "session", "token", "retry", "queue", "worker", "config", "lock"
+};
+
+/** Levels used for log messages. */
+static char const *levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN",
+                                "ERROR" };
+
+/** Print a usage message and exit unsuccessfully. */
+static void usage()
+{
+  fprintf( stderr, "usage: gencorpus <random|log|pathological> <megabytes> "
+           "[seed]\n" );
+  exit( EXIT_FAILURE );
+}
+
+/**
+   Return a random number from 0 up to (but not including) n.
+
+   @param n number of values to choose from.
+   @return the random number.
+*/
+static int pick( int n )
+{
+  return rand() % n;
+}
+
+/**
+   Write a line of random printable characters.
+
+   @return number of bytes written, including the newline.
+*/
+static long randomLine()
+{
+  int len = pick( MAX_RANDOM_LINE + 1 );
+  for ( int i = 0; i < len; i++ )
+    putchar( ' ' + pick( '~' - ' ' + 1 ) );
+  putchar( '\n' );
+  return len + 1;
+}
+
+/**
+   Write a line that looks like a message in a server log.
+
+   @param number line number, used for the timestamp.
+   @return number of bytes written, including the newline.
+*/
+static long logLine( long number )
+{
+  int nwords = sizeof( words ) / sizeof( words[ 0 ] );
+  int nlevels = sizeof( levels ) / sizeof( levels[ 0 ] );
+  long len = printf( "2024-%02d-%02d %02ld:%02ld:%02ld [%s] %s %s %d",
+                     pick( 12 ) + 1, pick( 28 ) + 1, number / 3600 % 24,
+                     number / 60 % 60, number % 60,
+                     levels[ pick( nlevels ) ], words[ pick( nwords ) ],
+                     words[ pick( nwords ) ], pick( 100000 ) );
+  if ( pick( 10 ) == 0 )
+    len += printf( " disk %d%% full", pick( 100 ) );
+  putchar( '\n' );
+  return len + 1;
+}
+
+/**
+   Write a long run of a's, ending in a b on only a few lines, so
+   patterns looking for a's then a b have to try every way to match.
+
+   @return number of bytes written, including the newline.
+*/
+static long pathologicalLine()
+{
+  for ( int i = 0; i < PATHOLOGICAL_LINE; i++ )
+    putchar( 'a' );
+  putchar( pick( 100 ) == 0 ? 'b' : 'a' );
+  putchar( '\n' );
+  return PATHOLOGICAL_LINE + 2;
+}
+
+/**
+   Entry point for the program.  Writes lines of the requested kind to
+   standard output until it's written the requested size.
+
+   @param argc Number of command-line arguments.
+   @param argv List of command-line arguments.
+   @return exit status for the program.
+*/
+int main( int argc, char *argv[] )
+{
+  int megabytes;
+  unsigned int seed = DEFAULT_SEED;
+  if ( argc < 3 || argc > 4 || sscanf( argv[ 2 ], "%d", &megabytes ) != 1
+       || megabytes < 0
+       || ( argc == 4 && sscanf( argv[ 3 ], "%u", &seed ) != 1 ) )
+    usage();
+
+  char const *kind = argv[ 1 ];
+  if ( strcmp( kind, "random" ) != 0 && strcmp( kind, "log" ) != 0
+       && strcmp( kind, "pathological" ) != 0 )
+    usage();
+
+  srand( seed );
+  long size = (long) megabytes * MEGABYTE;
+  long written = 0;
+  for ( long number = 0; written < size; number++ ) {
+    if ( kind[ 0 ] == 'r' )
+      written += randomLine();
+    else if ( kind[ 0 ] == 'l' )
+      written += logLine( number );
+    else
+      written += pathologicalLine();
+  }
+  return EXIT_SUCCESS;
+}
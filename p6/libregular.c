@@ -0,0 +1,81 @@
+/**
+ * Component program for the library interface.  A compiled pattern is
+ * an optimized automaton, with a prefilter for its required literal,
+ * and a pool of match contexts so each call can match on its own copy
+ * of the automaton's scratch space.
+ *
+ * @file libregular.c
+ * @author Jimmy Nguyen (jnguyen6)
+ */
+
+#include "libregular.h"
+#include "parse.h"
+#include "pool.h"
+#include <stdlib.h>
+
+/** Representation for a compiled pattern. */
+struct RegularStruct {
+  /** The pattern contexts are cloned from.  It's never matched itself. */
+  Pattern *pat;
+
+  /** Match contexts for the pattern. */
+  PatternPool *pool;
+};
+
+// Documented in the header.
+Regular *regularCompile( char const *pattern, int flags )
+{
+  bool ignoreCase = flags & REGULAR_IGNORE_CASE;
+  Pattern *pat = parsePatternFlags( pattern,
+                                    ignoreCase ? PARSE_IGNORE_CASE : 0, NULL );
+  if ( !pat )
+    return NULL;
+
+  pat = makePrefilterPattern( makeAutomatonPattern( optimizePattern( pat ) ) );
+  if ( ignoreCase )
+    pat = makeCaselessPattern( pat );
+
+  Regular *re = (Regular *) malloc( sizeof( Regular ) );
+  re->pat = pat;
+  re->pool = makePatternPool( pat );
+  return re;
+}
+
+// Documented in the header.
+bool regularMatch( Regular *re, char const *str )
+{
+  Pattern *ctx = acquireContext( re->pool );
+  bool matched = ctx->test( ctx, str );
+  releaseContext( re->pool, ctx );
+  return matched;
+}
+
+// Documented in the header.
+bool regularSearch( Regular *re, char const *str, int from, int *begin,
+                    int *end )
+{
+  Pattern *ctx = acquireContext( re->pool );
+  ctx->locate( ctx, str );
+  bool found = from >= 0 && from <= ctx->len
+    && ctx->search( ctx, from, begin, end );
+  releaseContext( re->pool, ctx );
+  return found;
+}
+
+// Documented in the header.
+int regularFindAll( Regular *re, char const *str, RegularHandler handler,
+                    void *data )
+{
+  Pattern *ctx = acquireContext( re->pool );
+  int count = findMatches( ctx, str, handler, data );
+  releaseContext( re->pool, ctx );
+  return count;
+}
+
+// Documented in the header.
+void regularFree( Regular *re )
+{
+  freePatternPool( re->pool );
+  re->pat->destroy( re->pat );
+  free( re );
+}
@@ -0,0 +1,97 @@
+/**
+ * Header file for the libregular.c component, the interface for using
+ * the matcher as a library instead of running the regular program.  A
+ * pattern is compiled once, then any number of threads can match
+ * strings against it at the same time.  Nothing here prints messages
+ * or exits the program, and the types are opaque, so programs using
+ * the library don't depend on how patterns are represented.
+ *
+ * @file libregular.h
+ * @author Jimmy Nguyen (jnguyen6)
+ */
+
+#ifndef LIBREGULAR_H
+#define LIBREGULAR_H
+
+#include <stdbool.h>
+
+/** Marks a function as part of the library's interface.  Everything
+    else in the shared library is hidden from programs using it. */
+#define REGULAR_API __attribute__(( visibility( "default" ) ))
+
+/** Flag for regularCompile() that makes the pattern ignore the case of
+    ASCII letters, like the -i option. */
+#define REGULAR_IGNORE_CASE 0x1
+
+/** Short name for a compiled pattern. */
+typedef struct RegularStruct Regular;
+
+/** Compile the given pattern for matching.
+
+    @param pattern string containing the pattern.
+    @param flags REGULAR_IGNORE_CASE, or 0.
+    @return a dynamically allocated compiled pattern, or NULL if the
+            pattern is invalid.
+*/
+REGULAR_API Regular *regularCompile( char const *pattern, int flags );
+
+/** Report whether the compiled pattern matches anywhere in the given
+    string.  This is safe to call from several threads at once.
+
+    @param re compiled pattern.
+    @param str string to check.
+    @return true if some substring of str matches the pattern.
+*/
+REGULAR_API bool regularMatch( Regular *re, char const *str );
+
+/** Find the leftmost-longest match of the compiled pattern in the
+    given string that begins at or after index from.  Each call looks
+    over the whole string again before it searches, so it takes time
+    in proportion to the length of str, not just the part after from.
+    Calling it again from the end of each match would take quadratic
+    time to find every match in a long string; regularFindAll() finds
+    them all in one pass.  This is safe to call from several threads at
+    once.
+
+    @param re compiled pattern.
+    @param str string to search.
+    @param from first index where the match may begin.
+    @param begin returns the index of the first character in the match.
+    @param end returns the index one past the end of the match.
+    @return true if a match was found.
+*/
+REGULAR_API bool regularSearch( Regular *re, char const *str, int from,
+                                int *begin, int *end );
+
+/** Type for a function that's called for each match regularFindAll()
+    reports.
+
+    @param begin index of the first character in the match.
+    @param end index one past the end of the match.
+    @param data value given to regularFindAll().
+*/
+typedef void (*RegularHandler)( int begin, int end, void *data );
+
+/** Find every leftmost-longest match of the compiled pattern in the
+    given string, left to right, and call handler for each one.  The
+    matches don't overlap, and an empty match right after another match
+    isn't reported.  This looks over the string once, so it's the way to
+    find all the matches in a long string.  This is safe to call from
+    several threads at once.
+
+    @param re compiled pattern.
+    @param str string to search.
+    @param handler function called for each match, in order.
+    @param data value passed to the handler.
+    @return the number of matches reported.
+*/
+REGULAR_API int regularFindAll( Regular *re, char const *str,
+                                RegularHandler handler, void *data );
+
+/** Free a compiled pattern.  No other thread can be using it.
+
+    @param re compiled pattern to free.
+*/
+REGULAR_API void regularFree( Regular *re );
+
+#endif
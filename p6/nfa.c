@@ -0,0 +1,1274 @@
+/**
+ * Component program that implements the automaton used to match
+ * regular expressions in time linear in the length of the input.
+ * This program provides functions for building the states of the
+ * automaton, finding out if a string contains any match by
+ * simulating a lazily-built DFA, and finding the leftmost-longest
+ * match by simulating the automaton directly with a list of threads,
+ * either in a string or in a stream given a chunk at a time.
+ *
+ * @file nfa.c
+ * @author Jimmy Nguyen (jnguyen6)
+ */
+
+#include "nfa.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** Initial capacity for the array of states in an automaton. */
+#define INITIAL_CAPACITY 16
+
+/** Number of possible values for a byte of input. */
+#define ALPHABET_SIZE 256
+
+/** Maximum number of DFA states we cache before starting over. */
+#define DFA_MAX_STATES 2048
+
+/** Number of slots in the hash table used to look up DFA states.  This
+    is a power of two, at least twice DFA_MAX_STATES. */
+#define DFA_HASH_SIZE 4096
+
+/** Initial capacity of the buffer kept by a stream. */
+#define STREAM_CAPACITY 4096
+
+/** Value used in the DFA cache for a transition or answer we haven't
+    computed yet. */
+#define UNKNOWN -1
+
+/** A list of threads, used when simulating the automaton directly.
+    Each thread is at some state and remembers where its match began,
+    and where it passed any capture states. */
+typedef struct {
+  /** State for each thread. */
+  int *states;
+
+  /** Index in the input where each thread's match began. */
+  int *begins;
+
+  /** Capture slots for each thread, with the slots for thread i
+      starting at index i * slots.  This is only used by nfaCaptures(). */
+  int *caps;
+
+  /** Number of threads in the list. */
+  int count;
+} ThreadList;
+
+/** A state of the lazily-built DFA.  It represents a set of automaton
+    states, along with transitions to other DFA states, filled in the
+    first time they are needed. */
+typedef struct {
+  /** Sorted list of automaton states in this DFA state. */
+  int *set;
+
+  /** Number of automaton states in set. */
+  int size;
+
+  /** True if this is the state used at the start of the input. */
+  bool bol;
+
+  /** True if set contains a match state. */
+  bool accept;
+
+  /** IDs of the match states in set. */
+  int *ids;
+
+  /** Number of IDs in ids. */
+  int idCount;
+
+  /** 1 if this state matches when it's reached at the end of the
+      input, 0 if it doesn't, UNKNOWN if we haven't checked yet. */
+  int endAccept;
+
+  /** IDs of the patterns that match if this state is reached at the
+      end of the input, once endAccept is known. */
+  int *endIds;
+
+  /** Number of IDs in endIds. */
+  int endIdCount;
+
+  /** Index of the DFA state to move to on each input byte, or UNKNOWN. */
+  int next[ ALPHABET_SIZE ];
+} DfaState;
+
+/** Scratch space used while simulating an automaton. */
+typedef struct NfaScratchStruct {
+  /** Current and next list of threads, for nfaSearch(). */
+  ThreadList clist, nlist;
+
+  /** Generation number for each state, used to keep states from being
+      added to a list more than once. */
+  unsigned int *mark;
+
+  /** Current generation number. */
+  unsigned int gen;
+
+  /** Generation number for each pattern ID, used to report each
+      matching pattern once. */
+  unsigned int *idMark;
+
+  /** Current generation number for idMark. */
+  unsigned int idGen;
+
+  /** Stack used when following transitions that don't consume input. */
+  int *stack;
+
+  /** Number of capture slots used by the automaton's save states. */
+  int slots;
+
+  /** Capture slots for the path being followed by addCaptureThread(). */
+  int *caps;
+
+  /** Stack used by addCaptureThread(), with room for a slot and a
+      value to put back for each save state along with each state. */
+  int *capStack;
+
+  /** List of states being collected for a new DFA state. */
+  int *work;
+
+  /** Cache of DFA states. */
+  DfaState *dstates[ DFA_MAX_STATES ];
+
+  /** Number of DFA states in the cache. */
+  int dcount;
+
+  /** Hash table of DFA state indices, keyed by their sets of states. */
+  int hash[ DFA_HASH_SIZE ];
+
+  /** DFA state for the start of the input, or UNKNOWN. */
+  int startBol;
+
+  /** DFA state for starting past the start of the input, or UNKNOWN. */
+  int startMid;
+
+  /** Number of times the DFA cache has been emptied. */
+  int flushes;
+
+  /** Automaton matching the reverse of every string this one matches,
+      if every match has to end at the end of the input but not begin
+      at the start.  Then the input is checked backward from the end,
+      instead of from every position. */
+  Nfa *reverse;
+
+  /** True once we've decided whether to make the reverse automaton. */
+  bool reverseChecked;
+} NfaScratch;
+
+/** Add a new state to the automaton, growing the state array if needed.
+
+    @param nfa automaton to add to.
+    @param type type of the new state.
+    @param out first state the new state moves to.
+    @param out1 second state the new state moves to.
+    @return index of the new state.
+*/
+static int addState( Nfa *nfa, StateType type, int out, int out1 )
+{
+  if ( nfa->count >= nfa->capacity ) {
+    nfa->capacity *= 2;
+    nfa->states = (NfaState *) realloc( nfa->states,
+                                        nfa->capacity * sizeof( NfaState ) );
+  }
+
+  NfaState *st = nfa->states + nfa->count;
+  st->type = type;
+  st->out = out;
+  st->out1 = out1;
+  st->id = 0;
+  csetClear( &st->cset );
+  return nfa->count++;
+}
+
+// Documented in the header.
+Nfa *makeNfa()
+{
+  Nfa *nfa = (Nfa *) malloc( sizeof( Nfa ) );
+  nfa->capacity = INITIAL_CAPACITY;
+  nfa->count = 0;
+  nfa->states = (NfaState *) malloc( nfa->capacity * sizeof( NfaState ) );
+  nfa->scratch = NULL;
+  nfa->shares = (int *) malloc( sizeof( int ) );
+  *nfa->shares = 1;
+  nfa->match = addState( nfa, STATE_MATCH, UNKNOWN, UNKNOWN );
+  nfa->start = nfa->match;
+  nfa->ids = 1;
+  return nfa;
+}
+
+// Documented in the header.
+int addMatchState( Nfa *nfa, int id )
+{
+  int s = addState( nfa, STATE_MATCH, UNKNOWN, UNKNOWN );
+  nfa->states[ s ].id = id;
+  if ( id >= nfa->ids )
+    nfa->ids = id + 1;
+  return s;
+}
+
+// Documented in the header.
+int addCharState( Nfa *nfa, CharSet const *cset, int out )
+{
+  int s = addState( nfa, STATE_CHAR, out, UNKNOWN );
+  nfa->states[ s ].cset = *cset;
+  return s;
+}
+
+// Documented in the header.
+int addSplitState( Nfa *nfa, int out, int out1 )
+{
+  return addState( nfa, STATE_SPLIT, out, out1 );
+}
+
+// Documented in the header.
+int addAssertState( Nfa *nfa, StateType type, int out )
+{
+  return addState( nfa, type, out, UNKNOWN );
+}
+
+// Documented in the header.
+int addSaveState( Nfa *nfa, int slot, int out )
+{
+  int s = addState( nfa, STATE_SAVE, out, UNKNOWN );
+  nfa->states[ s ].id = slot;
+  return s;
+}
+
+// Documented in the header.
+Nfa *copyNfa( Nfa const *nfa )
+{
+  Nfa *copy = (Nfa *) malloc( sizeof( Nfa ) );
+  *copy = *nfa;
+  copy->capacity = nfa->count;
+  copy->states = (NfaState *) malloc( copy->capacity * sizeof( NfaState ) );
+  memcpy( copy->states, nfa->states, nfa->count * sizeof( NfaState ) );
+  copy->scratch = NULL;
+  copy->shares = (int *) malloc( sizeof( int ) );
+  *copy->shares = 1;
+  return copy;
+}
+
+// Documented in the header.
+Nfa *shareNfa( Nfa *nfa )
+{
+  Nfa *share = (Nfa *) malloc( sizeof( Nfa ) );
+  *share = *nfa;
+  share->scratch = NULL;
+
+  // The automata may be freed on different threads.
+  __atomic_add_fetch( nfa->shares, 1, __ATOMIC_RELAXED );
+  return share;
+}
+
+// Documented in the header.
+int appendNfa( Nfa *dest, Nfa const *src, int next )
+{
+  int base = dest->count;
+  for ( int i = 0; i < src->count; i++ ) {
+    NfaState const *st = src->states + i;
+    if ( st->type == STATE_MATCH ) {
+      // Moving to next without consuming anything replaces the match.
+      addSplitState( dest, next, next );
+    } else {
+      int out1 = st->out1 == UNKNOWN ? UNKNOWN : st->out1 + base;
+      int s = addState( dest, st->type, st->out + base, out1 );
+      dest->states[ s ].id = st->id;
+      dest->states[ s ].cset = st->cset;
+    }
+  }
+  return src->start + base;
+}
+
+// Documented in the header.
+void foldNfa( Nfa *nfa, int first )
+{
+  for ( int i = first; i < nfa->count; i++ )
+    if ( nfa->states[ i ].type == STATE_CHAR )
+      csetFold( &nfa->states[ i ].cset );
+}
+
+/** Add another next state to a split state in a reverse automaton.  The
+    split starts out moving only to itself, which matches nothing, and
+    another split is added for each next state after the first.
+
+    @param rev reverse automaton.
+    @param split index of the split state.
+    @param next state it should also move to.
+*/
+static void addReverseEdge( Nfa *rev, int split, int next )
+{
+  NfaState *st = rev->states + split;
+  if ( st->out == split ) {
+    st->out = st->out1 = next;
+  } else {
+    int rest = addSplitState( rev, st->out, st->out1 );
+    rev->states[ split ].out = next;
+    rev->states[ split ].out1 = rest;
+  }
+}
+
+/** Make an automaton that matches the reverse of every string the given
+    one matches, for reading the input from the end back to the start.
+    Each state of nfa gets a split state standing for reaching it, which
+    moves back through every state that leads to it.  Going back through
+    a character state consumes the character, and the start and end of
+    input assertions trade places.  All the match states report ID 0.
+
+    @param nfa automaton to reverse.
+    @return a dynamically allocated reverse automaton.
+*/
+static Nfa *reverseNfa( Nfa const *nfa )
+{
+  Nfa *rev = makeNfa();
+  int base = rev->count;
+  for ( int i = 0; i < nfa->count; i++ )
+    addState( rev, STATE_SPLIT, base + i, base + i );
+
+  for ( int i = 0; i < nfa->count; i++ ) {
+    NfaState const *st = nfa->states + i;
+    int back = base + i;
+    if ( st->type == STATE_CHAR )
+      back = addCharState( rev, &st->cset, base + i );
+    else if ( st->type == STATE_BOL )
+      back = addAssertState( rev, STATE_EOL, base + i );
+    else if ( st->type == STATE_EOL )
+      back = addAssertState( rev, STATE_BOL, base + i );
+
+    if ( st->type != STATE_MATCH )
+      addReverseEdge( rev, base + st->out, back );
+    if ( st->type == STATE_SPLIT )
+      addReverseEdge( rev, base + st->out1, back );
+  }
+
+  // Reaching nfa's start state going backward is a match, and going
+  // backward starts from any of its match states.
+  addReverseEdge( rev, base + nfa->start, rev->match );
+  rev->start = UNKNOWN;
+  for ( int i = 0; i < nfa->count; i++ )
+    if ( nfa->states[ i ].type == STATE_MATCH )
+      rev->start = rev->start == UNKNOWN ? base + i :
+        addSplitState( rev, base + i, rev->start );
+  return rev;
+}
+
+/** Free all the DFA states in the cache and start over with an empty one.
+
+    @param s scratch space containing the cache.
+*/
+static void flushDfa( NfaScratch *s )
+{
+  for ( int i = 0; i < s->dcount; i++ ) {
+    free( s->dstates[ i ]->set );
+    free( s->dstates[ i ]->ids );
+    free( s->dstates[ i ]->endIds );
+    free( s->dstates[ i ] );
+  }
+  s->dcount = 0;
+  for ( int i = 0; i < DFA_HASH_SIZE; i++ )
+    s->hash[ i ] = UNKNOWN;
+  s->startBol = UNKNOWN;
+  s->startMid = UNKNOWN;
+  s->flushes++;
+}
+
+/** Return the scratch space for the given automaton, making it the first
+    time it's needed.
+
+    @param nfa automaton we're about to simulate.
+    @return scratch space for nfa.
+*/
+static NfaScratch *getScratch( Nfa *nfa )
+{
+  if ( nfa->scratch )
+    return nfa->scratch;
+
+  NfaScratch *s = (NfaScratch *) malloc( sizeof( NfaScratch ) );
+  s->clist.states = (int *) malloc( nfa->count * sizeof( int ) );
+  s->clist.begins = (int *) malloc( nfa->count * sizeof( int ) );
+  s->nlist.states = (int *) malloc( nfa->count * sizeof( int ) );
+  s->nlist.begins = (int *) malloc( nfa->count * sizeof( int ) );
+  s->mark = (unsigned int *) calloc( nfa->count, sizeof( unsigned int ) );
+  s->gen = 0;
+  s->idMark = (unsigned int *) calloc( nfa->ids, sizeof( unsigned int ) );
+  s->idGen = 0;
+  s->stack = (int *) malloc( ( 2 * nfa->count + 1 ) * sizeof( int ) );
+  s->work = (int *) malloc( nfa->count * sizeof( int ) );
+
+  // Space for captures is only made when it's needed.
+  s->slots = 0;
+  for ( int i = 0; i < nfa->count; i++ ) {
+    NfaState const *st = nfa->states + i;
+    if ( st->type == STATE_SAVE && st->id >= s->slots )
+      s->slots = st->id + 1;
+  }
+  s->clist.caps = s->nlist.caps = NULL;
+  s->caps = s->capStack = NULL;
+
+  s->dcount = 0;
+  s->flushes = 0;
+  flushDfa( s );
+  s->reverse = NULL;
+  s->reverseChecked = false;
+  nfa->scratch = s;
+  return s;
+}
+
+/** Add the given state to a list, along with every state reachable
+    from it without consuming input.  Only states that consume input,
+    check for the end of input or report a match are recorded in the list,
+    and a state isn't added if it's already been added in the current
+    generation.
+
+    @param nfa automaton we're simulating.
+    @param s scratch space for the automaton.
+    @param list list of states to add to.
+    @param count pass-by-reference number of states in the list.
+    @param state state to start from.
+    @param atBol true if we're at the start of the input.
+    @param atEnd true if we're at the end of the input.
+*/
+static void addClosure( Nfa *nfa, NfaScratch *s, int *list, int *count,
+                        int state, bool atBol, bool atEnd )
+{
+  int top = 0;
+  s->stack[ top++ ] = state;
+  while ( top > 0 ) {
+    int i = s->stack[ --top ];
+    if ( s->mark[ i ] == s->gen )
+      continue;
+    s->mark[ i ] = s->gen;
+
+    NfaState *st = nfa->states + i;
+    if ( st->type == STATE_SPLIT ) {
+      // Push out1 first, so out gets explored first.
+      s->stack[ top++ ] = st->out1;
+      s->stack[ top++ ] = st->out;
+    } else if ( st->type == STATE_BOL ) {
+      if ( atBol )
+        s->stack[ top++ ] = st->out;
+    } else if ( st->type == STATE_SAVE ) {
+      s->stack[ top++ ] = st->out;
+    } else {
+      list[ (*count)++ ] = i;
+      if ( st->type == STATE_EOL && atEnd )
+        s->stack[ top++ ] = st->out;
+    }
+  }
+}
+
+/** Add a thread for the given state to a thread list, along with
+    threads for every state reachable from it without consuming input.
+
+    @param nfa automaton we're simulating.
+    @param s scratch space for the automaton.
+    @param list list to add threads to.
+    @param state state for the new thread.
+    @param begin index where the thread's match began.
+    @param atBol true if we're at the start of the input.
+    @param atEnd true if we're at the end of the input.
+*/
+static void addThread( Nfa *nfa, NfaScratch *s, ThreadList *list, int state,
+                       int begin, bool atBol, bool atEnd )
+{
+  int first = list->count;
+  addClosure( nfa, s, list->states, &list->count, state, atBol, atEnd );
+  for ( int i = first; i < list->count; i++ )
+    list->begins[ i ] = begin;
+}
+
+/** Comparison function for sorting the states in a DFA state.
+
+    @param a pointer to the first state index.
+    @param b pointer to the second state index.
+    @return negative, zero or positive, like strcmp().
+*/
+static int compareStates( void const *a, void const *b )
+{
+  return *(int const *) a - *(int const *) b;
+}
+
+/** Compute a hash code for a set of states.
+
+    @param set sorted list of states.
+    @param size number of states in the list.
+    @param bol true if the set is for the start of the input.
+    @return hash code for the set.
+*/
+static unsigned int hashSet( int const *set, int size, bool bol )
+{
+  unsigned int h = 2166136261u ^ ( bol ? 1 : 0 );
+  for ( int i = 0; i < size; i++ )
+    h = ( h ^ (unsigned int) set[ i ] ) * 16777619u;
+  return h;
+}
+
+/** Find the DFA state for the set of states in the work list, adding it
+    to the cache if it's not already there.  This can empty the cache,
+    invalidating any DFA state indices held by the caller.
+
+    @param nfa automaton we're simulating.
+    @param s scratch space for the automaton.
+    @param size number of states in the work list.
+    @param bol true if this is a state for the start of the input.
+    @return index of the DFA state.
+*/
+static int lookupDfaState( Nfa *nfa, NfaScratch *s, int size, bool bol )
+{
+  qsort( s->work, size, sizeof( int ), compareStates );
+  unsigned int h = hashSet( s->work, size, bol ) % DFA_HASH_SIZE;
+  while ( s->hash[ h ] != UNKNOWN ) {
+    DfaState *ds = s->dstates[ s->hash[ h ] ];
+    if ( ds->bol == bol && ds->size == size &&
+         memcmp( ds->set, s->work, size * sizeof( int ) ) == 0 )
+      return s->hash[ h ];
+    h = ( h + 1 ) % DFA_HASH_SIZE;
+  }
+
+  if ( s->dcount >= DFA_MAX_STATES ) {
+    flushDfa( s );
+    h = hashSet( s->work, size, bol ) % DFA_HASH_SIZE;
+  }
+
+  DfaState *ds = (DfaState *) malloc( sizeof( DfaState ) );
+  ds->set = (int *) malloc( ( size + 1 ) * sizeof( int ) );
+  memcpy( ds->set, s->work, size * sizeof( int ) );
+  ds->size = size;
+  ds->bol = bol;
+  ds->ids = (int *) malloc( ( size + 1 ) * sizeof( int ) );
+  ds->idCount = 0;
+  for ( int i = 0; i < size; i++ )
+    if ( nfa->states[ ds->set[ i ] ].type == STATE_MATCH )
+      ds->ids[ ds->idCount++ ] = nfa->states[ ds->set[ i ] ].id;
+  ds->accept = ds->idCount > 0;
+  ds->endAccept = UNKNOWN;
+  ds->endIds = NULL;
+  ds->endIdCount = 0;
+  for ( int c = 0; c < ALPHABET_SIZE; c++ )
+    ds->next[ c ] = UNKNOWN;
+
+  s->dstates[ s->dcount ] = ds;
+  s->hash[ h ] = s->dcount;
+  return s->dcount++;
+}
+
+/** Return the DFA state where matching starts.
+
+    @param nfa automaton we're simulating.
+    @param s scratch space for the automaton.
+    @param bol true if we're starting at the start of the input.
+    @return index of the starting DFA state.
+*/
+static int startDfaState( Nfa *nfa, NfaScratch *s, bool bol )
+{
+  int *start = bol ? &s->startBol : &s->startMid;
+  if ( *start == UNKNOWN ) {
+    int size = 0;
+    s->gen++;
+    addClosure( nfa, s, s->work, &size, nfa->start, bol, false );
+    *start = lookupDfaState( nfa, s, size, bol );
+  }
+  return *start;
+}
+
+/** Compute the DFA state reached from state d on input byte c, and
+    remember it in the cache.
+
+    @param nfa automaton we're simulating.
+    @param s scratch space for the automaton.
+    @param d index of the current DFA state.
+    @param c next byte of input.
+    @return index of the next DFA state.
+*/
+static int stepDfa( Nfa *nfa, NfaScratch *s, int d, unsigned char c )
+{
+  DfaState *ds = s->dstates[ d ];
+  int size = 0;
+  s->gen++;
+  for ( int i = 0; i < ds->size; i++ ) {
+    NfaState *st = nfa->states + ds->set[ i ];
+    if ( st->type == STATE_CHAR && CSET_HAS( &st->cset, c ) )
+      addClosure( nfa, s, s->work, &size, st->out, false, false );
+  }
+
+  // A match can start at any position, so the start state is always
+  // part of the next DFA state.
+  addClosure( nfa, s, s->work, &size, nfa->start, false, false );
+
+  int flushes = s->flushes;
+  int next = lookupDfaState( nfa, s, size, false );
+  if ( flushes == s->flushes )
+    ds->next[ c ] = next;
+  return next;
+}
+
+/** Report whether the given DFA state matches if it's reached at the end
+    of the input.
+
+    @param nfa automaton we're simulating.
+    @param s scratch space for the automaton.
+    @param d index of the DFA state.
+    @return true if there's a match at the end of the input.
+*/
+static bool endAccept( Nfa *nfa, NfaScratch *s, int d )
+{
+  DfaState *ds = s->dstates[ d ];
+  if ( ds->endAccept == UNKNOWN ) {
+    // Match states reached at the end of the input are the ones already
+    // in the set, plus any reached by passing end-of-input assertions.
+    int size = 0;
+    s->gen++;
+    for ( int i = 0; i < ds->size; i++ ) {
+      NfaState *st = nfa->states + ds->set[ i ];
+      if ( st->type == STATE_MATCH )
+        s->work[ size++ ] = ds->set[ i ];
+      else if ( st->type == STATE_EOL )
+        addClosure( nfa, s, s->work, &size, st->out, ds->bol, true );
+    }
+
+    ds->endIds = (int *) malloc( ( size + 1 ) * sizeof( int ) );
+    for ( int i = 0; i < size; i++ )
+      if ( nfa->states[ s->work[ i ] ].type == STATE_MATCH )
+        ds->endIds[ ds->endIdCount++ ] = nfa->states[ s->work[ i ] ].id;
+    ds->endAccept = ds->endIdCount > 0;
+  }
+  return ds->endAccept == 1;
+}
+
+/** Report true if no match of the automaton can begin after the start
+    of the input, like for a pattern starting with '^'.  Then the DFA
+    state for past the start is empty, and so is every DFA state that
+    the threads from the start have all died out of.
+
+    @param nfa automaton we're simulating.
+    @param s scratch space for the automaton.
+    @return true if every match begins at the start of the input.
+*/
+static bool startAnchored( Nfa *nfa, NfaScratch *s )
+{
+  return s->dstates[ startDfaState( nfa, s, false ) ]->size == 0;
+}
+
+/** Return the reverse automaton for searching backward from the end of
+    the input, making it the first time it's needed.  That's only worth
+    doing if every match ends at the end of the input, like for a
+    pattern ending with '$', and if the forward search wouldn't stop
+    early anyway.
+
+    @param nfa automaton we're simulating.
+    @param s scratch space for the automaton.
+    @return the reverse automaton, or NULL if we should search forward.
+*/
+static Nfa *backwardAutomaton( Nfa *nfa, NfaScratch *s )
+{
+  if ( !s->reverseChecked ) {
+    s->reverseChecked = true;
+    if ( !startAnchored( nfa, s ) ) {
+      Nfa *rev = reverseNfa( nfa );
+      if ( startAnchored( rev, getScratch( rev ) ) )
+        s->reverse = rev;
+      else
+        freeNfa( rev );
+    }
+  }
+  return s->reverse;
+}
+
+/** Report true if the automaton matches a substring of str beginning at
+    or after index from, by simulating its reverse automaton from the
+    end of the input back to from.  Every match ends at the end of the
+    input, so this stops as soon as the DFA state is empty.
+
+    @param rev reverse automaton.
+    @param str the input string.
+    @param len length of the input string.
+    @param from first index where a match may begin.
+    @return true if there's a match.
+*/
+static bool testBackward( Nfa *rev, char const *str, int len, int from )
+{
+  NfaScratch *s = getScratch( rev );
+  int d = startDfaState( rev, s, true );
+  for ( int pos = len; pos > from; pos-- ) {
+    DfaState *ds = s->dstates[ d ];
+    if ( ds->accept )
+      return true;
+    if ( ds->size == 0 )
+      return false;
+    unsigned char c = str[ pos - 1 ];
+    d = ds->next[ c ] == UNKNOWN ? stepDfa( rev, s, d, c ) : ds->next[ c ];
+  }
+  return from == 0 ? endAccept( rev, s, d ) : s->dstates[ d ]->accept;
+}
+
+// Documented in the header.
+bool nfaTest( Nfa *nfa, char const *str, int len, int from )
+{
+  NfaScratch *s = getScratch( nfa );
+  Nfa *rev = backwardAutomaton( nfa, s );
+  if ( rev )
+    return testBackward( rev, str, len, from );
+
+  // An empty DFA state can't lead to a match, which lets an anchored
+  // pattern stop right after its first few characters.
+  int d = startDfaState( nfa, s, from == 0 );
+  for ( int pos = from; pos < len; pos++ ) {
+    DfaState *ds = s->dstates[ d ];
+    if ( ds->accept )
+      return true;
+    if ( ds->size == 0 )
+      return false;
+    unsigned char c = str[ pos ];
+    d = ds->next[ c ] == UNKNOWN ? stepDfa( nfa, s, d, c ) : ds->next[ c ];
+  }
+  return endAccept( nfa, s, d );
+}
+
+/** Look for threads that have reached a match state, and update the
+    best match found so far.  A match that begins further left is
+    better, then one that ends further right.
+
+    @param nfa automaton we're simulating.
+    @param list threads at the current position.
+    @param pos current index in the input.
+    @param bestBegin pass-by-reference start of the best match, or UNKNOWN.
+    @param bestEnd pass-by-reference end of the best match.
+*/
+static void updateBest( Nfa *nfa, ThreadList const *list, int pos,
+                        int *bestBegin, int *bestEnd )
+{
+  for ( int i = 0; i < list->count; i++ )
+    if ( nfa->states[ list->states[ i ] ].type == STATE_MATCH ) {
+      if ( *bestBegin == UNKNOWN || list->begins[ i ] < *bestBegin ) {
+        *bestBegin = list->begins[ i ];
+        *bestEnd = pos;
+      } else if ( list->begins[ i ] == *bestBegin && pos > *bestEnd ) {
+        *bestEnd = pos;
+      }
+    }
+}
+
+/** Move a list of threads past one byte of input, keeping only the
+    threads that can still produce a better match.
+
+    @param nfa automaton we're simulating.
+    @param s scratch space for the automaton.
+    @param clist threads at the current position.
+    @param nlist returns the threads at the next position.
+    @param c byte of input at the current position.
+    @param pos current index in the input.
+    @param bestBegin start of the best match so far, or UNKNOWN.
+    @param atEnd true if the next position is the end of the input.
+*/
+static void stepThreads( Nfa *nfa, NfaScratch *s, ThreadList const *clist,
+                         ThreadList *nlist, unsigned char c, int pos,
+                         int bestBegin, bool atEnd )
+{
+  nlist->count = 0;
+  s->gen++;
+  for ( int i = 0; i < clist->count; i++ ) {
+    NfaState *st = nfa->states + clist->states[ i ];
+    if ( bestBegin != UNKNOWN && clist->begins[ i ] > bestBegin )
+      continue;
+    if ( st->type == STATE_CHAR && CSET_HAS( &st->cset, c ) )
+      addThread( nfa, s, nlist, st->out, clist->begins[ i ], false, atEnd );
+  }
+
+  // Until we find a match, start a new thread at each position.
+  if ( bestBegin == UNKNOWN )
+    addThread( nfa, s, nlist, nfa->start, pos + 1, false, atEnd );
+}
+
+/** Find the leftmost match of the automaton beginning at or after index
+    from, by simulating its reverse automaton from the end of the input
+    back to from.  Every match ends at the end of the input, so the
+    leftmost one is also the longest.
+
+    @param rev reverse automaton.
+    @param str the input string.
+    @param len length of the input string.
+    @param from first index where the match may begin.
+    @param begin returns the index of the first character in the match.
+    @param end returns the index one past the end of the match.
+    @return true if there's a match.
+*/
+static bool searchBackward( Nfa *rev, char const *str, int len, int from,
+                            int *begin, int *end )
+{
+  NfaScratch *s = getScratch( rev );
+  int d = startDfaState( rev, s, true );
+  int found = UNKNOWN;
+  for ( int pos = len; ; pos-- ) {
+    DfaState *ds = s->dstates[ d ];
+    if ( pos == 0 ? endAccept( rev, s, d ) : ds->accept )
+      found = pos;
+    if ( pos == from || ds->size == 0 )
+      break;
+    unsigned char c = str[ pos - 1 ];
+    d = ds->next[ c ] == UNKNOWN ? stepDfa( rev, s, d, c ) : ds->next[ c ];
+  }
+
+  if ( found == UNKNOWN )
+    return false;
+  *begin = found;
+  *end = len;
+  return true;
+}
+
+// Documented in the header.
+bool nfaSearch( Nfa *nfa, char const *str, int len, int from,
+                int *begin, int *end )
+{
+  NfaScratch *s = getScratch( nfa );
+  Nfa *rev = backwardAutomaton( nfa, s );
+  if ( rev )
+    return searchBackward( rev, str, len, from, begin, end );
+  ThreadList *clist = &s->clist;
+  ThreadList *nlist = &s->nlist;
+
+  // Threads are kept in order of where their matches began, and a
+  // state is only added once per position, so the thread that reaches
+  // a state first is the one with the leftmost beginning.
+  clist->count = 0;
+  s->gen++;
+  addThread( nfa, s, clist, nfa->start, from, from == 0, from == len );
+
+  int bestBegin = UNKNOWN;
+  int bestEnd = UNKNOWN;
+  for ( int pos = from; clist->count > 0; pos++ ) {
+    updateBest( nfa, clist, pos, &bestBegin, &bestEnd );
+    if ( pos == len )
+      break;
+
+    stepThreads( nfa, s, clist, nlist, str[ pos ], pos, bestBegin,
+                 pos + 1 == len );
+    ThreadList *temp = clist;
+    clist = nlist;
+    nlist = temp;
+  }
+
+  if ( bestBegin == UNKNOWN )
+    return false;
+  *begin = bestBegin;
+  *end = bestEnd;
+  return true;
+}
+
+/** Add a thread for the given state to a thread list, along with
+    threads for every state reachable from it without consuming input,
+    like addThread().  Each new thread gets a copy of the capture slots
+    in s->caps, with the current position recorded in the slots of any
+    save states on the way to it.  Transitions are followed depth-first,
+    taking out before out1, so threads are added in order of preference.
+
+    @param nfa automaton we're simulating.
+    @param s scratch space for the automaton.
+    @param list list to add threads to.
+    @param state state for the new thread.
+    @param pos current index in the input.
+    @param len length of the input.
+*/
+static void addCaptureThread( Nfa *nfa, NfaScratch *s, ThreadList *list,
+                              int state, int pos, int len )
+{
+  // Entries are a state, or a slot (encoded as -2 - slot) followed by
+  // the value to put back in it once everything past the save state has
+  // been followed.
+  int top = 0;
+  s->capStack[ top++ ] = state;
+  while ( top > 0 ) {
+    int i = s->capStack[ --top ];
+    if ( i < 0 ) {
+      s->caps[ -2 - i ] = s->capStack[ --top ];
+      continue;
+    }
+    if ( s->mark[ i ] == s->gen )
+      continue;
+    s->mark[ i ] = s->gen;
+
+    NfaState *st = nfa->states + i;
+    if ( st->type == STATE_SPLIT ) {
+      s->capStack[ top++ ] = st->out1;
+      s->capStack[ top++ ] = st->out;
+    } else if ( st->type == STATE_BOL ) {
+      if ( pos == 0 )
+        s->capStack[ top++ ] = st->out;
+    } else if ( st->type == STATE_SAVE ) {
+      s->capStack[ top++ ] = s->caps[ st->id ];
+      s->capStack[ top++ ] = -2 - st->id;
+      s->caps[ st->id ] = pos;
+      s->capStack[ top++ ] = st->out;
+    } else {
+      memcpy( list->caps + list->count * s->slots, s->caps,
+              s->slots * sizeof( int ) );
+      list->states[ list->count++ ] = i;
+      if ( st->type == STATE_EOL && pos == len )
+        s->capStack[ top++ ] = st->out;
+    }
+  }
+}
+
+// Documented in the header.
+bool nfaCaptures( Nfa *nfa, char const *str, int len, int begin, int end,
+                  int *caps, int slots )
+{
+  NfaScratch *s = getScratch( nfa );
+  if ( !s->caps ) {
+    int room = s->slots ? s->slots : 1;
+    s->clist.caps = (int *) malloc( nfa->count * room * sizeof( int ) );
+    s->nlist.caps = (int *) malloc( nfa->count * room * sizeof( int ) );
+    s->caps = (int *) malloc( room * sizeof( int ) );
+    s->capStack = (int *) malloc( ( 4 * nfa->count + 1 ) * sizeof( int ) );
+  }
+  ThreadList *clist = &s->clist;
+  ThreadList *nlist = &s->nlist;
+
+  // Only threads that start at begin matter, and none of them can get
+  // past end, since the match has to end there.
+  for ( int i = 0; i < s->slots; i++ )
+    s->caps[ i ] = -1;
+  clist->count = 0;
+  s->gen++;
+  addCaptureThread( nfa, s, clist, nfa->start, begin, len );
+
+  for ( int pos = begin; pos < end && clist->count > 0; pos++ ) {
+    unsigned char c = str[ pos ];
+    nlist->count = 0;
+    s->gen++;
+    for ( int i = 0; i < clist->count; i++ ) {
+      NfaState *st = nfa->states + clist->states[ i ];
+      if ( st->type == STATE_CHAR && CSET_HAS( &st->cset, c ) ) {
+        memcpy( s->caps, clist->caps + i * s->slots,
+                s->slots * sizeof( int ) );
+        addCaptureThread( nfa, s, nlist, st->out, pos + 1, len );
+      }
+    }
+
+    ThreadList *temp = clist;
+    clist = nlist;
+    nlist = temp;
+  }
+
+  // The most preferred thread that matched has the captures we want.
+  for ( int i = 0; i < clist->count; i++ )
+    if ( nfa->states[ clist->states[ i ] ].type == STATE_MATCH ) {
+      for ( int j = 0; j < slots; j++ )
+        caps[ j ] = j < s->slots ? clist->caps[ i * s->slots + j ] : -1;
+      if ( slots > 1 ) {
+        caps[ 0 ] = begin;
+        caps[ 1 ] = end;
+      }
+      return true;
+    }
+  return false;
+}
+
+/** Add the IDs in a list to the IDs of patterns that have matched,
+    skipping any that are already there.
+
+    @param s scratch space for the automaton.
+    @param list IDs to add.
+    @param size number of IDs in list.
+    @param ids list of IDs that have matched.
+    @param count number of IDs in the ids list.
+    @return new number of IDs in the ids list.
+*/
+static int addIds( NfaScratch *s, int const *list, int size, int *ids,
+                   int count )
+{
+  for ( int i = 0; i < size; i++ )
+    if ( s->idMark[ list[ i ] ] != s->idGen ) {
+      s->idMark[ list[ i ] ] = s->idGen;
+      ids[ count++ ] = list[ i ];
+    }
+  return count;
+}
+
+// Documented in the header.
+int nfaMatches( Nfa *nfa, char const *str, int len, int *ids )
+{
+  NfaScratch *s = getScratch( nfa );
+  s->idGen++;
+  int count = 0;
+  int d = startDfaState( nfa, s, true );
+  int pos = 0;
+  for ( ; pos < len && count < nfa->ids; pos++ ) {
+    DfaState *ds = s->dstates[ d ];
+    count = addIds( s, ds->ids, ds->idCount, ids, count );
+    if ( ds->size == 0 )
+      break;
+    unsigned char c = str[ pos ];
+    d = ds->next[ c ] == UNKNOWN ? stepDfa( nfa, s, d, c ) : ds->next[ c ];
+  }
+
+  if ( pos == len && endAccept( nfa, s, d ) )
+    count = addIds( s, s->dstates[ d ]->endIds, s->dstates[ d ]->endIdCount,
+                    ids, count );
+  qsort( ids, count, sizeof( int ), compareStates );
+  return count;
+}
+
+/** Representation for a stream being matched a chunk at a time.  It
+    keeps the threads from the end of one chunk to the start of the
+    next, along with the input from where the earliest of them began. */
+struct NfaStreamStruct {
+  /** Automaton being simulated. */
+  Nfa *nfa;
+
+  /** Function called for each match. */
+  StreamHandler handler;
+
+  /** Value passed to the handler. */
+  void *data;
+
+  /** Input that may still be part of a match. */
+  char *buffer;
+
+  /** Number of bytes in the buffer. */
+  int len;
+
+  /** Number of bytes there's room for in the buffer. */
+  int capacity;
+
+  /** Offset in the stream of the first byte in the buffer.  Every other
+      position in the stream is kept as an index in the buffer. */
+  long base;
+
+  /** Threads at the current position, and space for the next ones. */
+  ThreadList clist, nlist;
+
+  /** Index of the position the threads have reached. */
+  int pos;
+
+  /** True while a search is running, false if the next one should
+      start at from once there's input there. */
+  bool searching;
+
+  /** Index where the next search starts. */
+  int from;
+
+  /** Start and end of the best match found by the current search, or
+      UNKNOWN. */
+  int bestBegin, bestEnd;
+
+  /** Offset in the stream where the last match reported ended, or
+      UNKNOWN. */
+  long prevEnd;
+
+  /** True once nothing else in the stream can match. */
+  bool done;
+};
+
+// Documented in the header.
+NfaStream *makeNfaStream( Nfa *nfa, StreamHandler handler, void *data )
+{
+  NfaStream *st = (NfaStream *) malloc( sizeof( NfaStream ) );
+  st->nfa = nfa;
+  st->handler = handler;
+  st->data = data;
+  st->capacity = STREAM_CAPACITY;
+  st->buffer = (char *) malloc( st->capacity );
+  st->len = 0;
+  st->base = 0;
+  st->clist.states = (int *) malloc( nfa->count * sizeof( int ) );
+  st->clist.begins = (int *) malloc( nfa->count * sizeof( int ) );
+  st->nlist.states = (int *) malloc( nfa->count * sizeof( int ) );
+  st->nlist.begins = (int *) malloc( nfa->count * sizeof( int ) );
+  st->clist.caps = st->nlist.caps = NULL;
+  st->clist.count = st->nlist.count = 0;
+  st->pos = 0;
+  st->searching = false;
+  st->from = 0;
+  st->bestBegin = st->bestEnd = UNKNOWN;
+  st->prevEnd = UNKNOWN;
+  st->done = false;
+  return st;
+}
+
+/** Run the search for the next match as far as the input in the buffer
+    goes.  Each match is reported as soon as no thread can make it any
+    better, and the search for the one after it starts where it ended,
+    going back over input that's already been seen if it has to.
+
+    @param st stream to match.
+    @param s scratch space for the stream's automaton.
+    @param final true if the buffer holds the rest of the stream.
+*/
+static void runStream( NfaStream *st, NfaScratch *s, bool final )
+{
+  Nfa *nfa = st->nfa;
+  while ( !st->done ) {
+    if ( !st->searching ) {
+      if ( st->from > st->len ) {
+        st->done = final;
+        return;
+      }
+      st->clist.count = 0;
+      s->gen++;
+      addThread( nfa, s, &st->clist, nfa->start, st->from,
+                 st->base + st->from == 0, final && st->from == st->len );
+      st->pos = st->from;
+      st->bestBegin = st->bestEnd = UNKNOWN;
+      st->searching = true;
+    }
+
+    updateBest( nfa, &st->clist, st->pos, &st->bestBegin, &st->bestEnd );
+    if ( st->clist.count > 0 && st->pos < st->len ) {
+      stepThreads( nfa, s, &st->clist, &st->nlist, st->buffer[ st->pos ],
+                   st->pos, st->bestBegin, final && st->pos + 1 == st->len );
+      ThreadList temp = st->clist;
+      st->clist = st->nlist;
+      st->nlist = temp;
+      st->pos++;
+      continue;
+    }
+
+    // Wait for more input if there are threads that could use it.
+    if ( st->clist.count > 0 && !final )
+      return;
+
+    // Without a match, there were no threads left, even for a match
+    // starting here, so nothing later can match either.
+    if ( st->bestBegin == UNKNOWN ) {
+      st->done = true;
+      return;
+    }
+
+    long begin = st->base + st->bestBegin;
+    long end = st->base + st->bestEnd;
+    if ( begin != end || begin != st->prevEnd ) {
+      st->handler( begin, end, st->buffer + st->bestBegin, st->data );
+      st->prevEnd = end;
+    }
+
+    // After an empty match, move past the next character so we don't
+    // keep finding the same match.
+    st->from = st->bestBegin == st->bestEnd ? st->bestEnd + 1 : st->bestEnd;
+    st->searching = false;
+  }
+}
+
+/** Drop input at the front of the buffer that can't be part of a match
+    any more.  This only moves the rest of the input once it's less than
+    half the buffer, so each byte is moved just a few times on average,
+    and it shrinks the buffer again once a long candidate match is gone.
+
+    @param st stream to trim.
+*/
+static void trimStream( NfaStream *st )
+{
+  int keep = st->from < st->len ? st->from : st->len;
+  if ( st->searching ) {
+    keep = st->pos;
+    if ( st->bestBegin != UNKNOWN && st->bestBegin < keep )
+      keep = st->bestBegin;
+    for ( int i = 0; i < st->clist.count; i++ )
+      if ( st->clist.begins[ i ] < keep )
+        keep = st->clist.begins[ i ];
+  }
+  if ( keep == 0 || keep < st->len - keep )
+    return;
+
+  memmove( st->buffer, st->buffer + keep, st->len - keep );
+  st->len -= keep;
+  st->base += keep;
+  st->pos -= keep;
+  st->from -= keep;
+  if ( st->bestBegin != UNKNOWN ) {
+    st->bestBegin -= keep;
+    st->bestEnd -= keep;
+  }
+  for ( int i = 0; i < st->clist.count; i++ )
+    st->clist.begins[ i ] -= keep;
+
+  // Give back the room a long candidate match needed once it's gone.
+  int capacity = st->capacity;
+  while ( capacity > STREAM_CAPACITY && st->len < capacity / 4 )
+    capacity /= 2;
+  if ( capacity < st->capacity ) {
+    st->capacity = capacity;
+    st->buffer = (char *) realloc( st->buffer, st->capacity );
+  }
+}
+
+// Documented in the header.
+void nfaFeed( NfaStream *st, char const *chunk, int n )
+{
+  if ( st->done )
+    return;
+
+  trimStream( st );
+  if ( st->len + n > st->capacity ) {
+    while ( st->len + n > st->capacity )
+      st->capacity *= 2;
+    st->buffer = (char *) realloc( st->buffer, st->capacity );
+  }
+  memcpy( st->buffer + st->len, chunk, n );
+  st->len += n;
+  runStream( st, getScratch( st->nfa ), false );
+}
+
+// Documented in the header.
+void nfaFinish( NfaStream *st )
+{
+  if ( st->done )
+    return;
+
+  // Threads that have already reached the end were added before we knew
+  // it was the end, so let them past any end-of-input assertions now.
+  // States already in the list are marked first, since other searches
+  // may have used the scratch space since then.
+  NfaScratch *s = getScratch( st->nfa );
+  if ( st->searching && st->pos == st->len ) {
+    ThreadList *list = &st->clist;
+    s->gen++;
+    for ( int i = 0; i < list->count; i++ )
+      s->mark[ list->states[ i ] ] = s->gen;
+    int count = list->count;
+    for ( int i = 0; i < count; i++ ) {
+      NfaState *state = st->nfa->states + list->states[ i ];
+      if ( state->type == STATE_EOL )
+        addThread( st->nfa, s, list, state->out, list->begins[ i ],
+                   st->base + st->pos == 0, true );
+    }
+  }
+  runStream( st, s, true );
+  st->done = true;
+}
+
+// Documented in the header.
+void freeNfaStream( NfaStream *st )
+{
+  free( st->buffer );
+  free( st->clist.states );
+  free( st->clist.begins );
+  free( st->nlist.states );
+  free( st->nlist.begins );
+  free( st );
+}
+
+// Documented in the header.
+void freeNfa( Nfa *nfa )
+{
+  NfaScratch *s = nfa->scratch;
+  if ( s ) {
+    flushDfa( s );
+    free( s->clist.states );
+    free( s->clist.begins );
+    free( s->nlist.states );
+    free( s->nlist.begins );
+    free( s->mark );
+    free( s->idMark );
+    free( s->stack );
+    free( s->work );
+    free( s->clist.caps );
+    free( s->nlist.caps );
+    free( s->caps );
+    free( s->capStack );
+    if ( s->reverse )
+      freeNfa( s->reverse );
+    free( s );
+  }
+  if ( __atomic_sub_fetch( nfa->shares, 1, __ATOMIC_ACQ_REL ) == 0 ) {
+    free( nfa->states );
+    free( nfa->shares );
+  }
+  free( nfa );
+}
@@ -0,0 +1,324 @@
+/**
+ * Header file for the nfa.c component, which provides a
+ * Thompson-style nondeterministic finite automaton built from a
+ * tree of Pattern objects. The automaton can be simulated one
+ * input position at a time, so a line can be matched in time
+ * linear in its length, either with a lazily-built DFA (to decide
+ * if a line matches at all) or with a thread list that reports the
+ * leftmost-longest match.  The thread list can also be carried from
+ * one chunk of a stream to the next.
+ *
+ * @file nfa.h
+ * @author Jimmy Nguyen (jnguyen6)
+ */
+
+#ifndef NFA_H
+#define NFA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "charset.h"
+
+/** Types of states an automaton can contain. */
+typedef enum {
+  /** Consumes one character from a CharSet and moves to out. */
+  STATE_CHAR,
+  /** Moves to both out and out1 without consuming anything. */
+  STATE_SPLIT,
+  /** Moves to out only at the start of the input string. */
+  STATE_BOL,
+  /** Moves to out only at the end of the input string. */
+  STATE_EOL,
+  /** Reaching this state means the pattern has matched. */
+  STATE_MATCH,
+  /** Records the current position in capture slot id, then moves to
+      out without consuming anything. */
+  STATE_SAVE
+} StateType;
+
+/** One state in the automaton. */
+typedef struct {
+  /** What this state does. */
+  StateType type;
+
+  /** Index of the next state. */
+  int out;
+
+  /** Index of the second next state, for STATE_SPLIT. */
+  int out1;
+
+  /** Which pattern has matched, for STATE_MATCH, or which capture
+      slot to record, for STATE_SAVE. */
+  int id;
+
+  /** Characters accepted by a STATE_CHAR. */
+  CharSet cset;
+} NfaState;
+
+/** Short name for the automaton type. */
+typedef struct NfaStruct Nfa;
+
+/**
+  Representation for an automaton.  States are stored in a resizable
+  array and refer to each other by index.  The automaton also keeps
+  scratch space used while simulating it and a cache of DFA states
+  built as they are needed.  Once built, the states aren't changed by
+  simulating the automaton, so several automata can share them, each
+  with its own scratch space.
+*/
+struct NfaStruct {
+  /** Array of states. */
+  NfaState *states;
+
+  /** Number of states in use. */
+  int count;
+
+  /** Capacity of the states array. */
+  int capacity;
+
+  /** Index of the state where matching starts. */
+  int start;
+
+  /** Index of the match state for pattern 0. */
+  int match;
+
+  /** Number of pattern IDs used by the automaton's match states. */
+  int ids;
+
+  /** Scratch space and DFA cache used during simulation, created the
+      first time the automaton is simulated. */
+  struct NfaScratchStruct *scratch;
+
+  /** Number of automata using the states array, which is freed along
+      with the last of them. */
+  int *shares;
+};
+
+/** Make an empty automaton, containing just the match state for
+    pattern 0.  An automaton can match several patterns at once, each
+    leading to its own match state with its own ID.
+
+    @return a dynamically allocated automaton.
+*/
+Nfa *makeNfa();
+
+/** Add a state that consumes one character from the given set.
+
+    @param nfa automaton to add to.
+    @param cset characters this state accepts.
+    @param out state to move to after consuming a character.
+    @return index of the new state.
+*/
+int addCharState( Nfa *nfa, CharSet const *cset, int out );
+
+/** Add a match state for the pattern with the given ID.  ID 0 is
+    already used by the automaton's first match state.
+
+    @param nfa automaton to add to.
+    @param id ID of the pattern this state reports.
+    @return index of the new state.
+*/
+int addMatchState( Nfa *nfa, int id );
+
+/** Add a state that moves to two other states without consuming input.
+
+    @param nfa automaton to add to.
+    @param out first state to move to.
+    @param out1 second state to move to.
+    @return index of the new state.
+*/
+int addSplitState( Nfa *nfa, int out, int out1 );
+
+/** Add a state for a zero-width assertion, STATE_BOL or STATE_EOL.
+
+    @param nfa automaton to add to.
+    @param type which assertion this state checks.
+    @param out state to move to if the assertion holds.
+    @return index of the new state.
+*/
+int addAssertState( Nfa *nfa, StateType type, int out );
+
+/** Add a state that records the current position in a capture slot.
+    Group n of a pattern uses slot 2n for where it begins and slot
+    2n + 1 for where it ends.
+
+    @param nfa automaton to add to.
+    @param slot capture slot to record the position in.
+    @param out state to move to next.
+    @return index of the new state.
+*/
+int addSaveState( Nfa *nfa, int slot, int out );
+
+/** Make a copy of the given automaton, with its own scratch space.
+
+    @param nfa automaton to copy.
+    @return a dynamically allocated copy of nfa.
+*/
+Nfa *copyNfa( Nfa const *nfa );
+
+/** Make an automaton that shares the states of the given one, but has
+    its own scratch space, so the two can be simulated on different
+    threads at the same time.  This is much cheaper than copying the
+    states, but no states can be added to or changed in either
+    automaton afterward.
+
+    @param nfa automaton whose states should be shared.
+    @return a dynamically allocated automaton using nfa's states.
+*/
+Nfa *shareNfa( Nfa *nfa );
+
+/** Add copies of all the states of one automaton to another, so the
+    copied states match the same strings and then move to the given
+    next state instead of reporting a match.
+
+    @param dest automaton to add states to.
+    @param src automaton to copy states from.
+    @param next state to move to where src would report a match.
+    @return index of the copy of src's start state.
+*/
+int appendNfa( Nfa *dest, Nfa const *src, int next );
+
+/** Make the character states of an automaton accept both cases of every
+    ASCII letter they accept, so it doesn't care about case.  This has
+    to be done before the automaton is simulated, since simulating it
+    caches transitions.
+
+    @param nfa automaton to fold.
+    @param first index of the first state to fold, so just the states
+                 added for part of a pattern can be folded.
+*/
+void foldNfa( Nfa *nfa, int first );
+
+/** Report true if the automaton matches any substring of str that
+    begins at or after index from.  This uses the DFA cache and stops
+    at the first position where a match is known to exist, or where no
+    match is possible any more.  An automaton where every match begins
+    at the start of the input, like for a pattern starting with '^',
+    only looks at the input until its first threads die out.  If every
+    match ends at the end of the input instead, like for a pattern
+    ending with '$', the input is read backward from the end with a
+    reverse automaton, made the first time it's needed.
+
+    @param nfa automaton to simulate.
+    @param str the input string.
+    @param len length of the input string.
+    @param from first index where a match may begin.
+    @return true if there's a match.
+*/
+bool nfaTest( Nfa *nfa, char const *str, int len, int from );
+
+/** Find the leftmost-longest match of the automaton that begins at or
+    after index from in the given string.  Like nfaTest(), this reads
+    the input backward from the end if every match has to end there.
+
+    @param nfa automaton to simulate.
+    @param str the input string.
+    @param len length of the input string.
+    @param from first index where a match may begin.
+    @param begin returns the index of the first character in the match.
+    @param end returns the index one past the end of the match.
+    @return true if there's a match.
+*/
+bool nfaSearch( Nfa *nfa, char const *str, int len, int from,
+                int *begin, int *end );
+
+/** Find where the capture groups are in a match found by nfaSearch().
+    The automaton is simulated from the beginning of the match with a
+    capture array for each thread, and the match has to end at exactly
+    the same place.  When the groups could split the match in more than
+    one way, the thread that takes the first branch of an alternation
+    and repeats as many times as it can is preferred.  This takes time
+    linear in the length of the match.
+
+    @param nfa automaton to simulate.
+    @param str the input string.
+    @param len length of the input string.
+    @param begin index of the first character in the match.
+    @param end index one past the end of the match.
+    @param caps returns the position recorded in each capture slot, or
+                -1 for a slot that wasn't reached.  Slots 0 and 1 are
+                set to begin and end.
+    @param slots number of slots in caps.
+    @return true if the automaton matches [ begin, end ).
+*/
+bool nfaCaptures( Nfa *nfa, char const *str, int len, int begin, int end,
+                  int *caps, int slots );
+
+/** Find the IDs of all the patterns that match some substring of str.
+    This uses the DFA cache, and it stops early if every pattern has
+    matched.
+
+    @param nfa automaton to simulate.
+    @param str the input string.
+    @param len length of the input string.
+    @param ids returns the IDs of the patterns that matched, in
+               increasing order.  This needs room for nfa->ids values.
+    @return the number of patterns that matched.
+*/
+int nfaMatches( Nfa *nfa, char const *str, int len, int *ids );
+
+/** Function called for each match found in a stream.
+
+    @param begin offset in the stream of the first character in the match.
+    @param end offset in the stream one past the end of the match.
+    @param text the characters of the match, only valid during the call.
+    @param data value given when the stream was made.
+*/
+typedef void (*StreamHandler)( long begin, long end, char const *text,
+                               void *data );
+
+/** Short name for the stream type. */
+typedef struct NfaStreamStruct NfaStream;
+
+/** Make a stream that finds the matches of an automaton in input given
+    a chunk at a time, like a log that's still being written or a file
+    with one enormous line.  Matches are the ones nfaSearch() would find
+    one after another if the whole stream were one string, so they can span
+    chunks (and newlines), ^ only matches at the start of the stream and
+    $ only at its end.  The automaton's state is carried from one chunk
+    to the next, and the stream only keeps the input from where the
+    earliest match still in progress began.  So memory isn't constant:
+    it's bounded by the longest candidate match, not by the length of
+    the stream.  A pattern like a.*b has to keep everything after an a
+    until it knows whether a b follows, since the whole match is given
+    to the handler.  The stream uses the automaton's scratch space, so
+    it shouldn't be used on more than one thread at once.
+
+    @param nfa automaton to simulate.  It has to outlive the stream.
+    @param handler function called for each match, in order.
+    @param data value passed to the handler.
+    @return a dynamically allocated stream.
+*/
+NfaStream *makeNfaStream( Nfa *nfa, StreamHandler handler, void *data );
+
+/** Give the stream its next chunk of input, reporting any matches that
+    can't get any longer.  Matches that could still be extended by the
+    next chunk are reported later.
+
+    @param st stream to add to.
+    @param chunk next bytes of the stream.
+    @param n number of bytes in chunk.
+*/
+void nfaFeed( NfaStream *st, char const *chunk, int n );
+
+/** Mark the end of the stream, reporting all the matches that haven't
+    been reported yet.  Nothing can be fed to the stream after this.
+
+    @param st stream to finish.
+*/
+void nfaFinish( NfaStream *st );
+
+/** Free all the memory used by the given stream.
+
+    @param st stream to free.
+*/
+void freeNfaStream( NfaStream *st );
+
+/** Free the memory used by the given automaton, including its states
+    unless another automaton still shares them.
+
+    @param nfa automaton to free.
+*/
+void freeNfa( Nfa *nfa );
+
+#endif
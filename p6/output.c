@@ -0,0 +1,95 @@
+/**
+ * Component program for a buffered writer.  Output for a file is
+ * collected until the buffer is full and then written with a single
+ * fwrite(), while output kept in memory doubles the buffer whenever it
+ * runs out of room.
+ *
+ * @file output.c
+ * @author Jimmy Nguyen (jnguyen6)
+ */
+
+#include "output.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** Most digits (and sign) in the decimal form of a long. */
+#define MAX_DIGITS 21
+
+// Documented in the header.
+void initOutput( Output *out, FILE *fp, size_t capacity )
+{
+  out->fp = fp;
+  out->len = 0;
+  out->capacity = capacity;
+  out->buffer = (char *) malloc( capacity );
+}
+
+// Documented in the header.
+void writeBytes( Output *out, void const *data, size_t n )
+{
+  if ( out->len + n > out->capacity ) {
+    if ( out->fp ) {
+      flushOutput( out );
+
+      // Something too big for the buffer may as well go straight out.
+      if ( n > out->capacity ) {
+        fwrite( data, 1, n, out->fp );
+        return;
+      }
+    } else {
+      while ( out->len + n > out->capacity )
+        out->capacity *= 2;
+      out->buffer = (char *) realloc( out->buffer, out->capacity );
+    }
+  }
+  memcpy( out->buffer + out->len, data, n );
+  out->len += n;
+}
+
+// Documented in the header.
+void writeString( Output *out, char const *str )
+{
+  writeBytes( out, str, strlen( str ) );
+}
+
+// Documented in the header.
+void writeChar( Output *out, char c )
+{
+  if ( out->len < out->capacity )
+    out->buffer[ out->len++ ] = c;
+  else
+    writeBytes( out, &c, 1 );
+}
+
+// Documented in the header.
+void writeNumber( Output *out, long val )
+{
+  // Fill in digits from the end of a small buffer.
+  char digits[ MAX_DIGITS ];
+  int pos = MAX_DIGITS;
+  unsigned long mag = val < 0 ? -(unsigned long) val : (unsigned long) val;
+  do {
+    digits[ --pos ] = '0' + mag % 10;
+    mag /= 10;
+  } while ( mag );
+  if ( val < 0 )
+    digits[ --pos ] = '-';
+  writeBytes( out, digits + pos, MAX_DIGITS - pos );
+}
+
+// Documented in the header.
+void flushOutput( Output *out )
+{
+  if ( out->fp && out->len ) {
+    fwrite( out->buffer, 1, out->len, out->fp );
+    out->len = 0;
+  }
+}
+
+// Documented in the header.
+void freeOutput( Output *out )
+{
+  flushOutput( out );
+  free( out->buffer );
+  out->buffer = NULL;
+}
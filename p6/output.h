@@ -0,0 +1,87 @@
+/**
+ * Header file for the output.c component, a buffered writer for the
+ * program's results.  Output is collected in a large buffer and
+ * written to its file in big blocks, instead of a few bytes at a time
+ * for every call.  An output without a file just keeps growing its
+ * buffer, so results can be collected in memory and written out later.
+ *
+ * @file output.h
+ * @author Jimmy Nguyen (jnguyen6)
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/** Capacity of the buffer for output written to a file. */
+#define OUTPUT_CAPACITY ( 1024 * 1024 )
+
+/** A buffer for output on its way to a file, or collected in memory. */
+typedef struct {
+  /** File the output is written to, or NULL to keep it in memory. */
+  FILE *fp;
+
+  /** Output that hasn't been written to the file yet. */
+  char *buffer;
+
+  /** Number of bytes in the buffer. */
+  size_t len;
+
+  /** Number of bytes there's room for in the buffer. */
+  size_t capacity;
+} Output;
+
+/** Initialize an output with an empty buffer.
+
+    @param out output to initialize.
+    @param fp file to write to, or NULL to collect the output in memory.
+    @param capacity initial capacity of the buffer.  For a file, this is
+                    how much output is collected before it's written.
+*/
+void initOutput( Output *out, FILE *fp, size_t capacity );
+
+/** Add bytes to the output.
+
+    @param out output to add to.
+    @param data bytes to add.
+    @param n number of bytes.
+*/
+void writeBytes( Output *out, void const *data, size_t n );
+
+/** Add a null-terminated string to the output.
+
+    @param out output to add to.
+    @param str string to add, without its null terminator.
+*/
+void writeString( Output *out, char const *str );
+
+/** Add one character to the output.
+
+    @param out output to add to.
+    @param c character to add.
+*/
+void writeChar( Output *out, char c );
+
+/** Add a number to the output, in decimal.
+
+    @param out output to add to.
+    @param val number to add.
+*/
+void writeNumber( Output *out, long val );
+
+/** Write everything in the buffer to the output's file.  This doesn't
+    do anything for output kept in memory.
+
+    @param out output to flush.
+*/
+void flushOutput( Output *out );
+
+/** Flush an output and free its buffer.
+
+    @param out output to free.
+*/
+void freeOutput( Output *out );
+
+#endif
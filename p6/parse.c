@@ -1,7 +1,11 @@
 /**
  * Component program that provides functions for parsing
  * the given string that represents a regular expression
- * into a collection (tree) of Pattern objects.
+ * into a collection (tree) of Pattern objects.  The parser
+ * makes one pass over the string without recursion, keeping
+ * a stack of the groups (parentheses) it's inside.  It records
+ * the pattern as a flat pool of nodes that refer to each other
+ * by index, then builds the Pattern objects from the pool.
  *
  * @file parse.c
  * @author Jimmy Nguyen (jnguyen6)
@@ -10,283 +14,430 @@
 
 #include "parse.h"
 #include <string.h>
-#include <stdio.h>
 #include <stdlib.h>
 
+/** Largest number allowed in a {m,n} repetition. */
+#define MAX_BOUND 1000
+
+/** Initial capacity for the node pool and the stack of groups. */
+#define INITIAL_CAPACITY 16
+
+/** Kinds of nodes in the node pool, one for each type of pattern. */
+typedef enum {
+  NODE_SYMBOL,
+  NODE_METACHAR,
+  NODE_CLASS,
+  NODE_CONCAT,
+  NODE_ALTERNATION,
+  NODE_REPETITION,
+  NODE_CAPTURE
+} NodeType;
+
+/** One node in the pool, a pattern to build once parsing is done. */
+typedef struct {
+  /** Kind of pattern this node is for. */
+  NodeType type;
+
+  /** The character matched by a symbol or metacharacter. */
+  char sym;
+
+  /** Index of the first subpattern, or of the start of a character
+      class in the pattern string. */
+  int left;
+
+  /** Index of the second subpattern, or the length of a character
+      class. */
+  int right;
+
+  /** Minimum number of occurrences for a repetition, or the group
+      number for a capture. */
+  int min;
+
+  /** Maximum number of occurrences for a repetition, or -1. */
+  int max;
+} ParseNode;
+
+/** Resizable pool of nodes.  A node is only added after any nodes it
+    refers to, so building patterns in index order always has the
+    subpatterns ready. */
+typedef struct {
+  /** The nodes. */
+  ParseNode *nodes;
+
+  /** Number of nodes in the pool. */
+  int count;
+
+  /** Number of nodes there's room for. */
+  int capacity;
+} NodePool;
+
+/** What's been parsed so far for a group, or for the whole pattern.
+    Nodes are referred to by index, with -1 for none. */
+typedef struct {
+  /** Alternation of the alternatives before the last '|'. */
+  int alt;
+
+  /** Concatenation of the current alternative, except the last atom. */
+  int prev;
+
+  /** The last atom of the current alternative, with any repetitions. */
+  int last;
+
+  /** True if the last atom has a {m,n} range, so it can't be repeated
+      again. */
+  bool bounded;
+
+  /** Number of the group, if its match is captured. */
+  int number;
+} Group;
+
 /**
-   Return true if the given character is ordinary, if it should just
-   match occurrences of itself.  This returns false for metacharacters
-   like '*' that control how patterns are matched.
+   Add a node to the pool, growing it if needed.
 
-   @param c Character that should be evaluated as ordinary or special.
-   @return True if c is not special.
+   @param pool The pool to add to.
+   @param type Kind of node to add.
+   @param left Index of the first subpattern, if there is one.
+   @param right Index of the second subpattern, if there is one.
+   @return index of the new node.
 */
-static bool ordinary( char c )
+static int addNode( NodePool *pool, NodeType type, int left, int right )
 {
-  // See if c is on our list of special characters.
-  if ( strchr( ".^$*?+|()[{", c ) )
-    return false;
-  return true;
+  if ( pool->count >= pool->capacity ) {
+    pool->capacity *= 2;
+    pool->nodes = (ParseNode *) realloc( pool->nodes,
+                                         pool->capacity * sizeof( ParseNode ) );
+  }
+  ParseNode *node = pool->nodes + pool->count;
+  node->type = type;
+  node->sym = '\0';
+  node->left = left;
+  node->right = right;
+  node->min = node->max = 0;
+  return pool->count++;
 }
 
 /**
-  Print the appropriate error message for an invalid pattern and exit
-  unsuccessfully.
+   Add a pattern that was just parsed to the end of the current
+   alternative.  The atom before it is concatenated onto the rest of
+   the alternative now, since it can't get any more repetitions.
+
+   @param pool The node pool.
+   @param group The group being parsed.
+   @param atom Index of the node for the new pattern.
 */
-static void invalidPattern()
+static void addAtom( NodePool *pool, Group *group, int atom )
 {
-  fprintf( stderr, "Invalid pattern\n" );
-  exit( EXIT_FAILURE );
+  if ( group->last >= 0 ) {
+    group->prev = group->prev < 0 ? group->last :
+      addNode( pool, NODE_CONCAT, group->prev, group->last );
+  }
+  group->last = atom;
+  group->bounded = false;
 }
 
 /**
-   Parse regular expression syntax with the highest precedence,
-   individual, ordinary symbols, start and end anchors, character
-   classes and patterns surrounded by parentheses.
+   Finish the current alternative of a group at a '|', a ')' or the end
+   of the pattern, adding it to the group's alternation.  An empty
+   alternative is an invalid pattern.
+
+   @param pool The node pool.
+   @param group The group being parsed.
+   @return index of the node for everything parsed in the group so far,
+           or -1 if the alternative is empty.
+*/
+static int endAlternative( NodePool *pool, Group *group )
+{
+  if ( group->last < 0 )
+    return -1;
+  int seq = group->prev < 0 ? group->last :
+    addNode( pool, NODE_CONCAT, group->prev, group->last );
+  group->alt = group->alt < 0 ? seq :
+    addNode( pool, NODE_ALTERNATION, group->alt, seq );
+  group->prev = group->last = -1;
+  group->bounded = false;
+  return group->alt;
+}
+
+/**
+   Parse one of the numbers in a {m,n} repetition.  The number can't be
+   larger than MAX_BOUND, since the automaton gets a copy of the repeated
+   pattern for each occurrence.
 
    @param str The string being parsed.
    @param pos A pass-by-reference value for the location in str being parsed,
-              increased as characters from str are parsed.
-   @return a dynamically allocated representation of the pattern for the next
-           portion of str.
+              increased past the digits of the number.
+   @return the value of the number, or -1 if it's too large.
 */
-static Pattern *parseAtomicPattern( char const *str, int *pos )
+static int parseBound( char const *str, int *pos )
 {
-  if ( ordinary( str[ *pos ] ) )
-    return makeSymbolPattern( str[ (*pos)++ ] );
-
-  //Metacharacter
-  if ( strchr( ".^$", str[ *pos ] ) )
-    return makeMetacharPattern( str[ (*pos)++ ] );
-    
-  //Character class
-  if ( strchr( "[", str[ *pos ] ) ) {
-    char cclass[ strlen( str ) + 1 ];
-    for ( int i = 0; i < strlen( str ); i++ ) {
-      cclass[ i ] = '\0';
-    }
-    cclass[ strlen( str ) ] = '\0';
-    bool validCClass = false;
-    bool foundPattern = false;
-    (*pos)++;
-    int index = 0;
-    while ( str[ *pos ] ) {
-      if ( str[ *pos ] == ']' && foundPattern ) {
-        validCClass = true;
-        (*pos)++;
-        break;
-      } else {
-        if ( str[ *pos ] == '-' ) {
-          if ( *pos - 1 >= 1 && ( *pos + 1 <= strlen( str ) - 1
-                 && str[ *pos + 1 ] != ']' ) ) {
-            if ( str[ *pos - 1 ] > str[ *pos + 1 ] ) {
-              validCClass = false;
-              break;
-            }
-          }
-        }
-        cclass[ index++ ] = str[ (*pos)++ ];
-        foundPattern = true;
-      }
-    }
-    cclass[ index ] = '\0';
-    if ( validCClass ) {
-      return makeCharClassPattern( cclass );
-    }
+  int val = 0;
+  while ( str[ *pos ] >= '0' && str[ *pos ] <= '9' ) {
+    val = val * 10 + ( str[ (*pos)++ ] - '0' );
+    if ( val > MAX_BOUND )
+      return -1;
   }
-  
-  //Parentheses
-  if ( strchr( "(", str[ *pos ] ) ) {
-    char subpat[ strlen( str ) + 1 ];
-    for ( int i = 0; i < strlen( str ); i++ ) {
-      subpat[ i ] = '\0';
-    }
-    subpat[ strlen( str ) ] = '\0';
-    bool validSubPattern = false;
-    bool foundPattern = false;
+  return val;
+}
+
+/**
+   Parse repetition syntax, '*', '+', '?' or a {m,n} range, and apply
+   it to the last atom of the current alternative.
+
+   @param str The string being parsed.
+   @param pos A pass-by-reference value for the location in str being parsed,
+              increased past the repetition syntax.
+   @param pool The node pool.
+   @param group The group being parsed.
+   @return false if the repetition is invalid.
+*/
+static bool parseRepetition( char const *str, int *pos, NodePool *pool,
+                             Group *group )
+{
+  // There has to be something to repeat, and a range ends the repetitions.
+  if ( group->last < 0 || group->bounded )
+    return false;
+
+  int min = 0;
+  int max = -1;
+  char c = str[ (*pos)++ ];
+  if ( c == '+' ) {
+    min = 1;
+  } else if ( c == '?' ) {
+    max = 1;
+  } else if ( c == '{' ) {
+    // Bounds are {m,n}, where either number can be left out.
+    if ( str[ *pos ] >= '0' && str[ *pos ] <= '9'
+         && ( min = parseBound( str, pos ) ) < 0 )
+      return false;
+    if ( str[ *pos ] != ',' )
+      return false;
     (*pos)++;
-    int index = 0;
-    while ( str[ *pos ] ) {
-      if ( str[ *pos ] == ')' && foundPattern ) {
-        validSubPattern = true;
-        (*pos)++;
-        break;
-      } else {
-        subpat[ index++ ] = str[ (*pos)++ ];
-        foundPattern = true;
-      }
-    }
-    subpat[ index ] = '\0';
-    if ( validSubPattern ) {
-      return parsePattern( subpat );
-    }
+    if ( str[ *pos ] >= '0' && str[ *pos ] <= '9'
+         && ( max = parseBound( str, pos ) ) < 0 )
+      return false;
+    if ( str[ *pos ] != '}' || ( max != -1 && min > max ) )
+      return false;
+    (*pos)++;
+    group->bounded = true;
   }
 
-  invalidPattern();
-  return NULL; // Just to make the compiler happy.
+  int node = addNode( pool, NODE_REPETITION, group->last, -1 );
+  pool->nodes[ node ].min = min;
+  pool->nodes[ node ].max = max;
+  group->last = node;
+  return true;
 }
 
 /**
-   Parse regular expression syntax with the second-highest precedence,
-   a pattern, p, optionally followed by one or more repetition syntax like '*' or '+'.
-   If there's no repetition syntax, it just returns the pattern object for p.
+   Parse a character class, like [a-z].  The node just records where
+   the members are in the pattern string.  A ']' right after the '['
+   is a member rather than the end of the class.  A '-' between two
+   members is a range, and the range can't be backward.
 
    @param str The string being parsed.
    @param pos A pass-by-reference value for the location in str being parsed,
-              increased as characters from str are parsed.
-   @return a dynamically allocated representation of the pattern for the next
-           portion of str.
+              increased past the class.
+   @param pool The node pool.
+   @return index of the node for the class, or -1 if it's invalid.
 */
-static Pattern *parseRepetition( char const *str, int *pos )
+static int parseCharClass( char const *str, int *pos, NodePool *pool )
 {
-  Pattern *p = parseAtomicPattern( str, pos );
-
-  while ( str[ *pos ] == '*' || str[ *pos ] == '+'
-            || str[ *pos ] == '?' || str[ *pos ] == '{' ) {
-    if ( str[ *pos ] == '*' ) {
-      p = makeRepetitionPattern( p, "*" );
-      (*pos)++;
-    } else if ( str[ *pos ] == '+' ) {
-      p = makeRepetitionPattern( p, "+" );
-      (*pos)++;
-    } else if ( str[ *pos ] == '?' ) {
-      p = makeRepetitionPattern( p, "?" );
-      (*pos)++;
-    } else if ( str[ *pos ] == '{' ) {
-      int seqidx = 0;
-      int firstNum;
-      int secondNum;
-      bool foundComma = false;
-      bool validSequence = false;
-      bool firstNumFound = false;
-      char sequence[ strlen( str ) + 1 ];
-      char num[ strlen( str ) + 1 ];
-      
-      //Initialize both sequence and num character array
-      for ( int i = 0; i < strlen( str ); i++ ) {
-        sequence[ i ] = '\0';
-        num[ i ] = '\0';
-      }
-      sequence[ strlen( str ) ] = '\0';
-      num[ strlen( str ) ] = '\0';
-      
-      int numidx = 0;
-      sequence[ seqidx++ ] = '{';
-      (*pos)++;
-      while ( str[ *pos ] ) {
-        if ( str[ *pos ] == '}' && foundComma ) {
-          if ( str[ *pos - 1 ] != ',' ) {
-            secondNum = atoi( num );
-            sequence[ seqidx++ ] = (char) secondNum;
-            if ( firstNumFound ) {
-              //If the first number is greater than the second,
-              //then this pattern is invalid.
-              if ( firstNum > secondNum ) {
-                break;
-              }
-            }
-          }
-          sequence[ seqidx++ ] = '}';
-          validSequence = true;
-          (*pos)++;
-          break;
-        } else if ( str[ *pos ] < '0' || str[ *pos ] > '9' ) {
-          //If we have reached a comma, set comma flag to true, and convert
-          //number to an int
-          if ( str[ *pos ] == ',' ) {
-            foundComma = true;
-            if ( str[ *pos - 1 ] != '{' ) {
-              firstNum = atoi( num );
-              sequence[ seqidx++ ] = (char) firstNum;
-              for ( int i = 0; i < strlen( str ); i++ ) {
-                num[ i ] = '\0';
-              }
-              num[ strlen( str ) ] = '\0';
-              numidx = 0;
-              firstNumFound = true;
-            }
-            sequence[ seqidx++ ] = ',';
-            (*pos)++;
-          } else {
-            validSequence = false;
-            break;
-          }
-        } else {
-          num[ numidx++ ] = str[ (*pos)++ ];
-        }
-      }
-      sequence[ seqidx ] = '\0';
-      if ( validSequence ) {
-        p = makeRepetitionPattern( p, sequence );
-        break;
-      } else {
-        invalidPattern();
-      }
-    }
+  int start = ++(*pos);
+  while ( str[ *pos ] && ( str[ *pos ] != ']' || *pos == start ) ) {
+    int i = *pos - start;
+    if ( str[ *pos ] == '-' && i >= 1 && !( i == 1 && str[ start ] == '^' )
+         && str[ *pos + 1 ] && str[ *pos + 1 ] != ']'
+         && str[ *pos - 1 ] > str[ *pos + 1 ] )
+      return -1;
+    (*pos)++;
   }
-  return p;
+  if ( !str[ *pos ] )
+    return -1;
+
+  int node = addNode( pool, NODE_CLASS, start, *pos - start );
+  (*pos)++;
+  return node;
 }
 
 /**
-   Parse regular expression syntax with the third-highest precedence,
-   one pattern, p, (optionally) followed by additional patterns
-   (concatenation).  If there are no additional patterns, it just
-   returns the pattern object for p.
+   Build a balanced tree of concatenations or alternations for a chain
+   of nodes.  The parser makes each chain left-deep, with one node per
+   atom or alternative, so building the nodes as they are would make a
+   tree as deep as the pattern is long, too deep for the methods that
+   walk it recursively.
 
-   @param str The string being parsed.
-   @param pos A pass-by-reference value for the location in str being parsed,
-              increased as characters from str are parsed.
-   @return a dynamically allocated representation of the pattern for the next
-           portion of str.
+   @param pool The node pool.
+   @param built Patterns already built for the nodes before top.
+   @param top Index of the last node in the chain, the one that isn't
+              the left side of another node like it.
+   @param chain Room for a pattern for every node in the pool.
+   @return the Pattern for the whole chain.
 */
-static Pattern *parseConcatenation( char const *str, int *pos )
+static Pattern *buildChain( NodePool const *pool, Pattern **built, int top,
+                            Pattern **chain )
 {
-  // Parse the first pattern
-  Pattern *p1 = parseRepetition( str, pos );
-  // While there are additional patterns, parse them
-  while ( str[ *pos ] && str[ *pos ] != '|' && str[ *pos ] != ')' ) {
-    Pattern *p2 = parseRepetition( str, pos );
-    // And build a concatenation pattern to match the sequence.
-    p1 = makeConcatenationPattern( p1, p2 );
+  // Collect the right sides walking down the chain, then reverse them.
+  NodeType type = pool->nodes[ top ].type;
+  int count = 0;
+  int i = top;
+  for ( ; pool->nodes[ i ].type == type; i = pool->nodes[ i ].left )
+    chain[ count++ ] = built[ pool->nodes[ i ].right ];
+  chain[ count++ ] = built[ i ];
+  for ( int a = 0, b = count - 1; a < b; a++, b-- ) {
+    Pattern *temp = chain[ a ];
+    chain[ a ] = chain[ b ];
+    chain[ b ] = temp;
   }
 
-  return p1;
+  return type == NODE_CONCAT ? makeConcatenationList( chain, count ) :
+    makeAlternationList( chain, count );
 }
 
 /**
-   Parse regular expression syntax with the lowest precedence, one
-   pattern, p, (optionally) followed by additional patterns separated
-   by | (alternation).  If there are no additional patterns, it just
-   returns the pattern object for p.
+   Build the Pattern objects for the nodes in the pool.  Nodes only
+   refer to nodes before them, so building in index order always has
+   the subpatterns ready, without any recursion.  A concatenation or
+   alternation that's the left side of another like it is skipped, and
+   built as part of the whole chain instead.
 
-   @param str The string being parsed.
-   @param pos A pass-by-reference value for the location in str being
-              parsed, increased as characters from str are parsed.
-   @return a dynamically allocated representation of the pattern for
-   the next portion of str.
+   @param pool The node pool.
+   @param str The string that was parsed, holding the character classes.
+   @param root Index of the node for the whole pattern.
+   @param ignoreCase True if symbols and classes should be folded to
+                     lowercase.
+   @return the Pattern for the root node.
 */
-static Pattern *parseAlternation( char const *str, int *pos )
+static Pattern *buildPatterns( NodePool const *pool, char const *str,
+                               int root, bool ignoreCase )
 {
-  Pattern *p1 = parseConcatenation( str, pos );
-  while ( str[ *pos ] == '|' ) {
-    (*pos)++;
-    Pattern *p2 = parseConcatenation( str, pos );
-    p1 = makeAlternationPattern( p1, p2 );
+  Pattern **built = (Pattern **) malloc( pool->count * sizeof( Pattern * ) );
+  Pattern **chain = (Pattern **) malloc( pool->count * sizeof( Pattern * ) );
+
+  // Find the nodes that are inside a longer chain.
+  bool *inner = (bool *) calloc( pool->count, sizeof( bool ) );
+  for ( int i = 0; i < pool->count; i++ ) {
+    ParseNode const *node = pool->nodes + i;
+    if ( ( node->type == NODE_CONCAT || node->type == NODE_ALTERNATION )
+         && pool->nodes[ node->left ].type == node->type )
+      inner[ node->left ] = true;
   }
-  
-  return p1;
+
+  for ( int i = 0; i < pool->count; i++ ) {
+    ParseNode const *node = pool->nodes + i;
+    if ( inner[ i ] ) {
+      built[ i ] = NULL;
+    } else if ( node->type == NODE_SYMBOL ) {
+      built[ i ] = makeSymbolPattern( ignoreCase ? foldCase( node->sym ) :
+                                      node->sym );
+    } else if ( node->type == NODE_METACHAR ) {
+      built[ i ] = makeMetacharPattern( node->sym );
+    } else if ( node->type == NODE_CLASS ) {
+      char *cclass = (char *) malloc( node->right + 1 );
+      memcpy( cclass, str + node->left, node->right );
+      cclass[ node->right ] = '\0';
+      built[ i ] = ignoreCase ? makeFoldedCharClassPattern( cclass ) :
+        makeCharClassPattern( cclass );
+      free( cclass );
+    } else if ( node->type == NODE_CONCAT
+                || node->type == NODE_ALTERNATION ) {
+      built[ i ] = buildChain( pool, built, i, chain );
+    } else if ( node->type == NODE_REPETITION ) {
+      built[ i ] = makeRepetitionPattern( built[ node->left ], node->min,
+                                          node->max );
+    } else {
+      built[ i ] = makeCapturePattern( built[ node->left ], node->min );
+    }
+  }
+
+  Pattern *pat = built[ root ];
+  free( inner );
+  free( chain );
+  free( built );
+  return pat;
 }
 
 // Documented in the header
-Pattern *parsePattern( char const *str )
+Pattern *parsePatternFlags( char const *str, int flags, int *groups )
 {
-  // Parse the argument into a tree of pattern objects.
+  NodePool pool = { NULL, 0, INITIAL_CAPACITY };
+  pool.nodes = (ParseNode *) malloc( pool.capacity * sizeof( ParseNode ) );
+
+  // Groups we're inside, and the one we're parsing now.
+  int depth = 0;
+  int stackCapacity = INITIAL_CAPACITY;
+  Group *stack = (Group *) malloc( stackCapacity * sizeof( Group ) );
+  Group group = { -1, -1, -1, false, 0 };
+  int count = 0;
+
+  // Stop at the first thing that makes the pattern invalid.
+  bool valid = true;
   int pos = 0;
-  Pattern *pat = parseAlternation( str, &pos );
+  while ( valid && str[ pos ] ) {
+    char c = str[ pos ];
+    if ( c == '*' || c == '+' || c == '?' || c == '{' ) {
+      valid = parseRepetition( str, &pos, &pool, &group );
+    } else if ( c == '|' ) {
+      valid = endAlternative( &pool, &group ) >= 0;
+      pos++;
+    } else if ( c == '(' ) {
+      if ( depth >= stackCapacity ) {
+        stackCapacity *= 2;
+        stack = (Group *) realloc( stack, stackCapacity * sizeof( Group ) );
+      }
+      stack[ depth++ ] = group;
+      group = (Group) { -1, -1, -1, false, ++count };
+      pos++;
+    } else if ( c == ')' ) {
+      // The group becomes an atom in the one around it.
+      int sub = depth == 0 ? -1 : endAlternative( &pool, &group );
+      if ( sub < 0 ) {
+        valid = false;
+        break;
+      }
+      if ( flags & PARSE_CAPTURE ) {
+        sub = addNode( &pool, NODE_CAPTURE, sub, -1 );
+        pool.nodes[ sub ].min = group.number;
+      }
+      group = stack[ --depth ];
+      addAtom( &pool, &group, sub );
+      pos++;
+    } else if ( c == '[' ) {
+      int node = parseCharClass( str, &pos, &pool );
+      if ( node < 0 )
+        valid = false;
+      else
+        addAtom( &pool, &group, node );
+    } else {
+      // Anything else is a metacharacter or an ordinary symbol.
+      int node = addNode( &pool, strchr( ".^$", c ) ? NODE_METACHAR :
+                          NODE_SYMBOL, -1, -1 );
+      pool.nodes[ node ].sym = c;
+      addAtom( &pool, &group, node );
+      pos++;
+    }
+  }
 
-  // Complain if this didn't consume the whole pattern.
-  if ( str[ pos ] )
-    invalidPattern();
+  // A group that's never closed is invalid too.
+  int root = valid && depth == 0 ? endAlternative( &pool, &group ) : -1;
 
+  Pattern *pat = NULL;
+  if ( root >= 0 )
+    pat = buildPatterns( &pool, str, root, flags & PARSE_IGNORE_CASE );
+  free( stack );
+  free( pool.nodes );
+  if ( groups )
+    *groups = count;
   return pat;
 }
+
+// Documented in the header
+Pattern *parsePattern( char const *str )
+{
+  return parsePatternFlags( str, 0, NULL );
+}
+
+// Documented in the header
+Pattern *parseCapturePattern( char const *str, int *groups )
+{
+  return parsePatternFlags( str, PARSE_CAPTURE, groups );
+}
@@ -13,11 +13,45 @@
 
 #include "pattern.h"
 
-/** Parse the given string into Pattern object.
+/** Parse the given string into Pattern object.  Nothing is printed
+    for an invalid pattern; the caller decides how to report it.
 
     @param str string cntaining a pattern.
-    @return pointer to a representation of the pattern.
+    @return pointer to a representation of the pattern, or NULL if the
+            pattern is invalid.
 ***/
 Pattern *parsePattern( char const *str );
 
+/** Parse the given string into a Pattern object, where each
+    parenthesized group captures the part of a match it covers.  Groups
+    are numbered from 1, in the order of their opening parentheses.
+
+    @param str string containing a pattern.
+    @param groups returns the number of groups in the pattern.
+    @return pointer to a representation of the pattern, or NULL if the
+            pattern is invalid.
+*/
+Pattern *parseCapturePattern( char const *str, int *groups );
+
+/** Flag for parsePatternFlags() that makes parenthesized groups capture,
+    like parseCapturePattern(). */
+#define PARSE_CAPTURE 0x1
+
+/** Flag for parsePatternFlags() that folds the pattern to lowercase, for
+    matching input folded the same way by makeCaselessPattern().  Letters
+    become lowercase, and character classes get the lowercase form of
+    every letter they match in either case. */
+#define PARSE_IGNORE_CASE 0x2
+
+/** Parse the given string into a Pattern object, with options.
+
+    @param str string containing a pattern.
+    @param flags PARSE_CAPTURE and PARSE_IGNORE_CASE, or'ed together.
+    @param groups if it's not NULL, returns the number of groups in the
+                  pattern.
+    @return pointer to a representation of the pattern, or NULL if the
+            pattern is invalid.
+*/
+Pattern *parsePatternFlags( char const *str, int flags, int *groups );
+
 #endif
@@ -18,6 +18,17 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <assert.h>
+
+#include <time.h>
+
+#if defined( __x86_64__ )
+#include <emmintrin.h>
+#include <x86intrin.h>
+#endif
+
+/** Number of bits in each word of a match table row. */
+#define WORD_BITS 64
 
 /** Free the table inside a pattern, if there is one.
 
@@ -25,34 +36,333 @@
 */
 static void freeTable( Pattern *this )
 {
-  if ( this->table ) {
-    for ( int r = 0; r <= this->len; r++ )
-      free( this->table[ r ] );
-    free( this->table );
-  }
+  free( this->table );
+}
+
+/** Initialize the fields used to keep track of a pattern's match table,
+    for a pattern that doesn't have a table yet.
+
+    @param this The pattern we're supposed to operate on.
+*/
+static void clearTable( Pattern *this )
+{
+  this->len = 0;
+  this->table = NULL;
+  this->words = 0;
+  this->capacity = 0;
+  memset( &this->stats, 0, sizeof( PatternStats ) );
 }
 
-/** Make and initialize a new match table inside the given pattern,
-    large enough to store matches for the given string.
+/** Prepare an empty match table inside the given pattern, large enough
+    to store matches for the given string.  If the table from the
+    previous input string is big enough, it's cleared and reused.
+    Otherwise, it's replaced with a larger one.
+
+    The string can't be longer than MAX_TABLE_LENGTH.  Only the -t
+    engine fills in tables, and it checks the length of each line first,
+    so running out of memory here is a fatal error.
 
     @param this The pattern we're supposed to operate on.
     @param str The string we're going to store mageches for */
 static void initTable( Pattern *this, char const *str )
 {
-  // If we already had a table, free it.
-  freeTable( this );
+  // We need one bit for each cell, with all the rows in one block of memory.
+  size_t len = strlen( str );
+  size_t words = ( len + WORD_BITS ) / WORD_BITS;
+  size_t size = ( len + 1 ) * words;
 
-  // Make a table big enough for str.
-  this->len = strlen( str );
-  this->table = (bool **) malloc( ( this->len + 1 ) * sizeof( bool * ) );
-  for ( int r = 0; r <= this->len; r++ )
-    this->table[ r ] = (bool *) calloc( ( this->len + 1 ), sizeof( bool ) );
+  this->stats.requests++;
+  if ( len <= MAX_TABLE_LENGTH && size <= this->capacity ) {
+    this->stats.reuses++;
+    memset( this->table, 0, size * sizeof( uint64_t ) );
+  } else {
+    freeTable( this );
+    this->capacity = 0;
+    this->table = NULL;
+    if ( len <= MAX_TABLE_LENGTH )
+      this->table = (uint64_t *) calloc( size, sizeof( uint64_t ) );
+    if ( !this->table ) {
+      fprintf( stderr, "Not enough memory for a match table\n" );
+      exit( EXIT_FAILURE );
+    }
+    this->capacity = size;
+    this->stats.bytes += size * sizeof( uint64_t );
+  }
+  this->len = len;
+  this->words = words;
+}
+
+/** Return a pointer to the given row of a pattern's match table.  Bit
+    end % 64 of word end / 64 in the row is set if the pattern matches
+    the [ begin, end ) substring.
+
+    @param this The pattern we're supposed to operate on.
+    @param begin The row we want.
+    @return pointer to the first word of the row.
+*/
+static uint64_t *tableRow( Pattern *this, int begin )
+{
+  return this->table + begin * this->words;
+}
+
+/** Record a match for the [ begin, end ) substring in the match table.
+
+    @param this The pattern we're supposed to operate on.
+    @param begin index of the first character in the substring
+    @param end index one-past-the-end of the substring
+*/
+static void setMatch( Pattern *this, int begin, int end )
+{
+  tableRow( this, begin )[ end / WORD_BITS ] |= (uint64_t) 1 << ( end % WORD_BITS );
+}
+
+/** Or all the bits of one table row into another, a word at a time.
+    Since a table is stored in one block, this can also or together
+    whole tables.
+
+    @param dest row to add bits to.
+    @param src row with the bits to add.
+    @param words number of words in each row.
+*/
+static void orRow( uint64_t *dest, uint64_t const *src, int words )
+{
+  int w = 0;
+#if defined( __x86_64__ )
+  // SSE2 is always there on x86-64, so do two words at a time.
+  for ( ; w + 2 <= words; w += 2 ) {
+    __m128i a = _mm_loadu_si128( (__m128i const *) ( dest + w ) );
+    __m128i b = _mm_loadu_si128( (__m128i const *) ( src + w ) );
+    _mm_storeu_si128( (__m128i *) ( dest + w ), _mm_or_si128( a, b ) );
+  }
+#endif
+  for ( ; w < words; w++ )
+    dest[ w ] |= src[ w ];
+}
+
+/** Mark single-character matches in a pattern's fresh table.  The
+    last row of the table is used to hold the positions where a single
+    character pattern matches, since no character starts at the end of
+    the string.  Each set bit i in that row is moved to cell [ i, i + 1 ].
+
+    @param this The pattern we're supposed to operate on.
+*/
+static void setSingleMatches( Pattern *this )
+{
+  uint64_t *found = tableRow( this, this->len );
+  for ( int w = 0; w < this->words; w++ ) {
+    uint64_t bits = found[ w ];
+    found[ w ] = 0;
+    while ( bits ) {
+      int begin = w * WORD_BITS + __builtin_ctzll( bits );
+      setMatch( this, begin, begin + 1 );
+      bits &= bits - 1;
+    }
+  }
 }
 
 // Documented in the header.
 bool matches( Pattern *pat, int begin, int end )
 {
-  return pat->table[ begin ][ end ];
+  return ( tableRow( pat, begin )[ end / WORD_BITS ] >> ( end % WORD_BITS ) ) & 1;
+}
+
+// Documented in the header.
+int findMatches( Pattern *pat, char const *str, MatchHandler handler,
+                 void *data )
+{
+  pat->locate( pat, str );
+
+  int count = 0;
+  int prevEnd = -1;
+  int from = 0;
+  int begin, end;
+  while ( from <= pat->len && pat->search( pat, from, &begin, &end ) ) {
+    if ( begin != end || begin != prevEnd ) {
+      handler( begin, end, data );
+      prevEnd = end;
+      count++;
+    }
+
+    // After an empty match, move past the next character so we don't
+    // keep finding the same match.
+    from = begin == end ? end + 1 : end;
+  }
+  return count;
+}
+
+/**
+   Function used with visit() to add up the counters for a tree of
+   patterns.
+
+   @param pat The pattern whose counters we're adding.
+   @param data Pointer to the PatternStats holding the total.
+*/
+static void addStats( Pattern *pat, void *data )
+{
+  addPatternStats( (PatternStats *) data, &pat->stats );
+}
+
+// Documented in the header.
+void addPatternStats( PatternStats *total, PatternStats const *stats )
+{
+  total->requests += stats->requests;
+  total->reuses += stats->reuses;
+  total->bytes += stats->bytes;
+  total->lines += stats->lines;
+  total->rejected += stats->rejected;
+  total->calls += stats->calls;
+  total->cycles += stats->cycles;
+  total->cells += stats->cells;
+}
+
+// Documented in the header.
+void patternStats( Pattern *pat, PatternStats *stats )
+{
+  memset( stats, 0, sizeof( PatternStats ) );
+  pat->visit( pat, addStats, stats );
+}
+
+/**
+   A visit() method for any pattern that doesn't contain subpatterns.
+
+   @param pat The pattern being visited.
+   @param fn Function to call for the pattern.
+   @param data Extra value to pass to fn.
+*/
+static void visitSimplePattern( Pattern *pat,
+                                void (*fn)( Pattern *pat, void *data ),
+                                void *data )
+{
+  fn( pat, data );
+}
+
+/**
+   Make a dynamically allocated copy of a string.
+
+   @param str The string to copy.
+   @return the copy.
+*/
+static char *copyString( char const *str )
+{
+  char *copy = (char *) malloc( strlen( str ) + 1 );
+  strcpy( copy, str );
+  return copy;
+}
+
+/**
+   Make a dynamically allocated string containing one string followed
+   by another.
+
+   @param a The first string.
+   @param b The second string.
+   @return the new string.
+*/
+static char *joinStrings( char const *a, char const *b )
+{
+  char *str = (char *) malloc( strlen( a ) + strlen( b ) + 1 );
+  strcpy( str, a );
+  strcat( str, b );
+  return str;
+}
+
+/**
+   Return the longer of two strings (or the first if they're the same
+   length).
+
+   @param a The first string.
+   @param b The second string.
+   @return the longer string.
+*/
+static char const *longerString( char const *a, char const *b )
+{
+  return strlen( b ) > strlen( a ) ? b : a;
+}
+
+/**
+   Fill in literal information for a pattern that only matches the
+   given string.
+
+   @param info The literal information to fill in.
+   @param exact The only string the pattern matches.
+*/
+static void exactLiteral( LiteralInfo *info, char const *exact )
+{
+  info->exact = copyString( exact );
+  info->prefix = copyString( exact );
+  info->suffix = copyString( exact );
+  info->required = copyString( exact );
+}
+
+/**
+   Fill in literal information for a pattern that doesn't require any
+   particular literal string.
+
+   @param info The literal information to fill in.
+*/
+static void noLiteral( LiteralInfo *info )
+{
+  info->exact = NULL;
+  info->prefix = copyString( "" );
+  info->suffix = copyString( "" );
+  info->required = copyString( "" );
+}
+
+/**
+   Free the strings in the given literal information.
+
+   @param info The literal information to free.
+*/
+static void freeLiteralInfo( LiteralInfo *info )
+{
+  free( info->exact );
+  free( info->prefix );
+  free( info->suffix );
+  free( info->required );
+}
+
+/**
+   A search() method for any pattern that records its matches in a
+   match table.  It checks begin positions from left to right, and
+   end positions from right to left, so the first match it finds is
+   the leftmost-longest one.
+
+   @param pat The pattern whose match table we're checking.
+   @param from First index where the match may begin.
+   @param begin Returns the index of the first character in the match.
+   @param end Returns the index one past the end of the match.
+   @return true if a match was found.
+*/
+static bool searchTable( Pattern *pat, int from, int *begin, int *end )
+{
+  for ( int b = from; b <= pat->len; b++ ) {
+    uint64_t *row = tableRow( pat, b );
+    for ( int w = pat->words - 1; w >= 0; w-- )
+      if ( row[ w ] ) {
+        *begin = b;
+        *end = w * WORD_BITS + WORD_BITS - 1 - __builtin_clzll( row[ w ] );
+        return true;
+      }
+  }
+  return false;
+}
+
+/**
+   A test() method for any pattern that records its matches in a match
+   table.  The table still has to be filled in, but then any set bit
+   means there's a match, so it's checked a word at a time.
+
+   @param pat The pattern to match.
+   @param str The input string.
+   @return true if the pattern matches anywhere in str.
+*/
+static bool testTable( Pattern *pat, char const *str )
+{
+  pat->locate( pat, str );
+  uint64_t const *table = tableRow( pat, 0 );
+  for ( int w = 0; w < ( pat->len + 1 ) * pat->words; w++ )
+    if ( table[ w ] )
+      return true;
+  return false;
 }
 
 /**
@@ -78,9 +388,20 @@ static void destroySimplePattern( Pattern *pat )
 */
 typedef struct {
   // Fields from our superclass.
+  PatternKind kind;
   int len;
-  bool **table;
+  uint64_t *table;
+  int words;
+  size_t capacity;
+  PatternStats stats;
   void (*locate)( Pattern *pat, char const *str );
+  bool (*search)( Pattern *pat, int from, int *begin, int *end );
+  bool (*test)( Pattern *pat, char const *str );
+  int (*compile)( Pattern *pat, Nfa *nfa, int next );
+  void (*visit)( Pattern *pat, void (*fn)( Pattern *pat, void *data ),
+                 void *data );
+  Pattern *(*clone)( Pattern *pat );
+  void (*analyze)( Pattern *pat, LiteralInfo *info );
   void (*destroy)( Pattern *pat );
   
   /** Symbol this pattern is supposed to match. */
@@ -99,9 +420,36 @@ static void locateSymbolPattern( Pattern *pat, char const *str )
 
   // Find all occurreces of the symbol we're supposed to match, and
   // mark them in the match table as matching, 1-character substrings.
-  for ( int begin = 0; str[ begin ]; begin++ )
-    if ( str[ begin ] == this->sym )
-      this->table[ begin ][ begin + 1 ] = true;
+  findSymbol( this->sym, str, pat->len, tableRow( pat, pat->len ) );
+  setSingleMatches( pat );
+}
+
+// Overridden compile() method for a SymbolPattern
+static int compileSymbolPattern( Pattern *pat, Nfa *nfa, int next )
+{
+  SymbolPattern *this = (SymbolPattern *) pat;
+
+  CharSet cset;
+  csetClear( &cset );
+  csetAdd( &cset, this->sym );
+  return addCharState( nfa, &cset, next );
+}
+
+// Overridden clone() method for a SymbolPattern
+static Pattern *cloneSymbolPattern( Pattern *pat )
+{
+  SymbolPattern *this = (SymbolPattern *) pat;
+
+  return makeSymbolPattern( this->sym );
+}
+
+// Overridden analyze() method for a SymbolPattern
+static void analyzeSymbolPattern( Pattern *pat, LiteralInfo *info )
+{
+  SymbolPattern *this = (SymbolPattern *) pat;
+
+  char str[] = { this->sym, '\0' };
+  exactLiteral( info, str );
 }
 
 // Documented in the header.
@@ -109,15 +457,155 @@ Pattern *makeSymbolPattern( char sym )
 {
   // Make an instance of SymbolPattern, and fill in its state.
   SymbolPattern *this = (SymbolPattern *) malloc( sizeof( SymbolPattern ) );
-  this->table = NULL;
+  clearTable( (Pattern *) this );
   
+  this->kind = SYMBOL_PATTERN;
   this->locate = locateSymbolPattern;
+  this->search = searchTable;
+  this->test = testTable;
+  this->compile = compileSymbolPattern;
+  this->visit = visitSimplePattern;
+  this->clone = cloneSymbolPattern;
+  this->analyze = analyzeSymbolPattern;
   this->destroy = destroySimplePattern;
   this->sym = sym;
 
   return (Pattern *) this;
 }
 
+/**
+   Type of pattern used to represent a string of two or more ordinary
+   symbols, like "abc".  The parser doesn't make these; the optimizer
+   makes them out of chains of concatenated symbols, so the whole string
+   is matched by one pattern with one table.
+*/
+typedef struct {
+  // Fields from our superclass.
+  PatternKind kind;
+  int len;
+  uint64_t *table;
+  int words;
+  size_t capacity;
+  PatternStats stats;
+  void (*locate)( Pattern *pat, char const *str );
+  bool (*search)( Pattern *pat, int from, int *begin, int *end );
+  bool (*test)( Pattern *pat, char const *str );
+  int (*compile)( Pattern *pat, Nfa *nfa, int next );
+  void (*visit)( Pattern *pat, void (*fn)( Pattern *pat, void *data ),
+                 void *data );
+  Pattern *(*clone)( Pattern *pat );
+  void (*analyze)( Pattern *pat, LiteralInfo *info );
+  void (*destroy)( Pattern *pat );
+
+  /** String this pattern is supposed to match. */
+  char *str;
+
+  /** Length of the string. */
+  int length;
+} LiteralPattern;
+
+/** Make a pattern that matches the first n characters of the given
+    string, a symbol pattern if n is 1 and a literal pattern otherwise.
+
+    @param str the characters to match.
+    @param n the number of characters, at least 1.
+    @return A dynamically allocated representation for this new pattern.
+*/
+static Pattern *makeStringPattern( char const *str, int n );
+
+// Overridden destroy() method for a LiteralPattern
+static void destroyLiteralPattern( Pattern *pat )
+{
+  LiteralPattern *this = (LiteralPattern *) pat;
+
+  freeTable( pat );
+  free( this->str );
+  free( this );
+}
+
+// Overridden locate() method for a LiteralPattern
+static void locateLiteralPattern( Pattern *pat, char const *str )
+{
+  LiteralPattern *this = (LiteralPattern *) pat;
+
+  initTable( pat, str );
+
+  // Find where the first character occurs, using the last row to hold
+  // the positions, then check for the rest of the string at each one.
+  // A match can't begin at the end of the string, so marking matches
+  // doesn't touch the last row.
+  uint64_t *found = tableRow( pat, pat->len );
+  findSymbol( this->str[ 0 ], str, pat->len, found );
+  for ( int w = 0; w < this->words; w++ ) {
+    uint64_t bits = found[ w ];
+    found[ w ] = 0;
+    for ( ; bits; bits &= bits - 1 ) {
+      int begin = w * WORD_BITS + __builtin_ctzll( bits );
+      if ( begin + this->length <= this->len
+           && memcmp( str + begin + 1, this->str + 1, this->length - 1 ) == 0 )
+        setMatch( pat, begin, begin + this->length );
+    }
+  }
+}
+
+// Overridden compile() method for a LiteralPattern
+static int compileLiteralPattern( Pattern *pat, Nfa *nfa, int next )
+{
+  LiteralPattern *this = (LiteralPattern *) pat;
+
+  // States are built back-to-front, so start with the last character.
+  CharSet cset;
+  for ( int i = this->length - 1; i >= 0; i-- ) {
+    csetClear( &cset );
+    csetAdd( &cset, this->str[ i ] );
+    next = addCharState( nfa, &cset, next );
+  }
+  return next;
+}
+
+// Overridden clone() method for a LiteralPattern
+static Pattern *cloneLiteralPattern( Pattern *pat )
+{
+  LiteralPattern *this = (LiteralPattern *) pat;
+
+  return makeStringPattern( this->str, this->length );
+}
+
+// Overridden analyze() method for a LiteralPattern
+static void analyzeLiteralPattern( Pattern *pat, LiteralInfo *info )
+{
+  LiteralPattern *this = (LiteralPattern *) pat;
+
+  exactLiteral( info, this->str );
+}
+
+// Documented above.
+static Pattern *makeStringPattern( char const *str, int n )
+{
+  if ( n == 1 )
+    return makeSymbolPattern( str[ 0 ] );
+
+  LiteralPattern *this = (LiteralPattern *) malloc( sizeof( LiteralPattern ) );
+  clearTable( (Pattern *) this );
+
+  this->kind = LITERAL_PATTERN;
+  this->locate = locateLiteralPattern;
+  this->search = searchTable;
+  this->test = testTable;
+  this->compile = compileLiteralPattern;
+  this->visit = visitSimplePattern;
+  this->clone = cloneLiteralPattern;
+  this->analyze = analyzeLiteralPattern;
+  this->destroy = destroyLiteralPattern;
+
+  this->str = (char *) malloc( n + 1 );
+  memcpy( this->str, str, n );
+  this->str[ n ] = '\0';
+  this->length = n;
+
+  return (Pattern *) this;
+}
+
 /**
    Representation for a type of pattern that contains two sub-patterns
    (e.g., concatenation).  This representation could be used by more
@@ -126,9 +614,20 @@ Pattern *makeSymbolPattern( char sym )
 */
 typedef struct {
   // Fields from our superclass.
+  PatternKind kind;
   int len;
-  bool **table;
+  uint64_t *table;
+  int words;
+  size_t capacity;
+  PatternStats stats;
   void (*locate)( Pattern *pat, char const *str );
+  bool (*search)( Pattern *pat, int from, int *begin, int *end );
+  bool (*test)( Pattern *pat, char const *str );
+  int (*compile)( Pattern *pat, Nfa *nfa, int next );
+  void (*visit)( Pattern *pat, void (*fn)( Pattern *pat, void *data ),
+                 void *data );
+  Pattern *(*clone)( Pattern *pat );
+  void (*analyze)( Pattern *pat, LiteralInfo *info );
   void (*destroy)( Pattern *pat );
   
   // Pointers to the two sub-patterns.
@@ -150,6 +649,18 @@ static void destroyBinaryPattern( Pattern *pat )
   free( this );
 }
 
+// visit function used for BinaryPattern
+static void visitBinaryPattern( Pattern *pat,
+                                void (*fn)( Pattern *pat, void *data ),
+                                void *data )
+{
+  BinaryPattern *this = (BinaryPattern *) pat;
+
+  this->p1->visit( this->p1, fn, data );
+  this->p2->visit( this->p2, fn, data );
+  fn( pat, data );
+}
+
 // locate function for a BinaryPattern used to handle concatenation.
 static void locateConcatenationPattern( Pattern *pat, const char *str )
 {
@@ -163,18 +674,62 @@ static void locateConcatenationPattern( Pattern *pat, const char *str )
   this->p2->locate( this->p2, str );
 
   // Then, based on their matches, look for all places where their
-  // concatenaton matches.  Check all substrings of the input string.
-  for ( int begin = 0; begin <= this->len; begin++ )
-    for ( int end = begin; end <= this->len; end++ ) {
-    
-      // For the [ begin, end ) range, check all places where it could
-      // be split into two substrings, the first matching p1 and the second
-      // matching p2.
-      for ( int k = begin; k <= end; k++ )
-        if ( matches( this->p1, begin, k ) &&
-             matches( this->p2, k, end ) )
-          this->table[ begin ][ end ] = true;
-    }
+  // concatenaton matches.  For every place, k, where a p1 match starting
+  // at begin ends, everything p2 matches starting at k is a match for
+  // us, so we can or in that whole row of p2's table.
+  for ( int begin = 0; begin <= this->len; begin++ ) {
+    uint64_t *row = tableRow( pat, begin );
+    uint64_t *row1 = tableRow( this->p1, begin );
+    for ( int w = 0; w < this->words; w++ )
+      for ( uint64_t bits = row1[ w ]; bits; bits &= bits - 1 ) {
+        int k = w * WORD_BITS + __builtin_ctzll( bits );
+        orRow( row, tableRow( this->p2, k ), this->words );
+      }
+  }
+}
+
+// compile function for a BinaryPattern used to handle concatenation.
+static int compileConcatenationPattern( Pattern *pat, Nfa *nfa, int next )
+{
+  BinaryPattern *this = (BinaryPattern *) pat;
+
+  // States are built back-to-front, so p2 comes first.
+  int second = this->p2->compile( this->p2, nfa, next );
+  return this->p1->compile( this->p1, nfa, second );
+}
+
+// clone function for a BinaryPattern used to handle concatenation.
+static Pattern *cloneConcatenationPattern( Pattern *pat )
+{
+  BinaryPattern *this = (BinaryPattern *) pat;
+
+  return makeConcatenationPattern( this->p1->clone( this->p1 ),
+                                   this->p2->clone( this->p2 ) );
+}
+
+// analyze function for a BinaryPattern used to handle concatenation.
+static void analyzeConcatenationPattern( Pattern *pat, LiteralInfo *info )
+{
+  BinaryPattern *this = (BinaryPattern *) pat;
+
+  LiteralInfo a, b;
+  this->p1->analyze( this->p1, &a );
+  this->p2->analyze( this->p2, &b );
+
+  // Literals at the end of p1 and the start of p2 run together.
+  info->exact = a.exact && b.exact ? joinStrings( a.exact, b.exact ) : NULL;
+  info->prefix = a.exact ? joinStrings( a.exact, b.prefix )
+    : copyString( a.prefix );
+  info->suffix = b.exact ? joinStrings( a.suffix, b.exact )
+    : copyString( b.suffix );
+
+  char *middle = joinStrings( a.suffix, b.prefix );
+  info->required = copyString( longerString( longerString( a.required,
+                                                           b.required ),
+                                             middle ) );
+  free( middle );
+  freeLiteralInfo( &a );
+  freeLiteralInfo( &b );
 }
 
 // Documented in header.
@@ -182,22 +737,52 @@ Pattern *makeConcatenationPattern( Pattern *p1, Pattern *p2 )
 {
   // Make an instance of Binary pattern and fill in its fields.
   BinaryPattern *this = (BinaryPattern *) malloc( sizeof( BinaryPattern ) );
-  this->table = NULL;
+  clearTable( (Pattern *) this );
   this->p1 = p1;
   this->p2 = p2;
   
+  this->kind = CONCATENATION_PATTERN;
   this->locate = locateConcatenationPattern;
+  this->search = searchTable;
+  this->test = testTable;
+  this->compile = compileConcatenationPattern;
+  this->visit = visitBinaryPattern;
+  this->clone = cloneConcatenationPattern;
+  this->analyze = analyzeConcatenationPattern;
   this->destroy = destroyBinaryPattern;
   
   return (Pattern *) this;
 }
 
+// Documented in header.
+Pattern *makeConcatenationList( Pattern **pats, int count )
+{
+  if ( count == 1 )
+    return pats[ 0 ];
+
+  int half = count / 2;
+  return makeConcatenationPattern( makeConcatenationList( pats, half ),
+                                   makeConcatenationList( pats + half,
+                                                          count - half ) );
+}
+
 /** Pattern that represents metacharacters, like '.', '$', and '^'. */
 typedef struct {
   // Fields from our superclass.
+  PatternKind kind;
   int len;
-  bool **table;
+  uint64_t *table;
+  int words;
+  size_t capacity;
+  PatternStats stats;
   void (*locate)( Pattern *pat, char const *str );
+  bool (*search)( Pattern *pat, int from, int *begin, int *end );
+  bool (*test)( Pattern *pat, char const *str );
+  int (*compile)( Pattern *pat, Nfa *nfa, int next );
+  void (*visit)( Pattern *pat, void (*fn)( Pattern *pat, void *data ),
+                 void *data );
+  Pattern *(*clone)( Pattern *pat );
+  void (*analyze)( Pattern *pat, LiteralInfo *info );
   void (*destroy)( Pattern *pat );
   
   /** The metacharacter this pattern is supposed to match. */
@@ -223,13 +808,69 @@ static void locateMetacharPattern( Pattern *pat, char const *str )
   if ( this->metachar == '.' ) {
     if ( strlen( str ) != 0 ) {
       for ( int begin = 0; str[ begin ]; begin++ ) {
-        this->table[ begin ][ begin + 1 ] = true;
+        setMatch( pat, begin, begin + 1 );
       }
     }
   } else if ( this->metachar == '^' ) {
-    this->table[ 0 ][ 0 ] = true;
+    setMatch( pat, 0, 0 );
+  } else {
+    setMatch( pat, pat->len, pat->len );
+  }
+}
+
+/**
+ * Method that adds states for the metacharacter pattern to an
+ * automaton. The '.' consumes any character, while '^' and '$' become
+ * assertions about the position in the input. This method is an
+ * overridden compile() method for the MetacharPattern.
+ *
+ * @param pat the metacharacter pattern
+ * @param nfa the automaton to add states to
+ * @param next the state to move to after a match
+ * @return the first state for this pattern
+ */
+static int compileMetacharPattern( Pattern *pat, Nfa *nfa, int next )
+{
+  MetacharPattern *this = (MetacharPattern *) pat;
+
+  if ( this->metachar == '.' ) {
+    CharSet cset;
+    csetClear( &cset );
+    for ( int c = 1; c < CSET_WORDS * CSET_WORD_BITS; c++ )
+      csetAdd( &cset, c );
+    return addCharState( nfa, &cset, next );
+  } else if ( this->metachar == '^' ) {
+    return addAssertState( nfa, STATE_BOL, next );
+  } else {
+    return addAssertState( nfa, STATE_EOL, next );
+  }
+}
+
+/** The overridden clone() function used for MetacharPattern. */
+static Pattern *cloneMetacharPattern( Pattern *pat )
+{
+  MetacharPattern *this = (MetacharPattern *) pat;
+
+  return makeMetacharPattern( this->metachar );
+}
+
+/**
+ * Method that finds literal strings required by the metacharacter
+ * pattern. The anchors match only the empty string, while '.' can
+ * match any character. This method is an overridden analyze() method
+ * for the MetacharPattern.
+ *
+ * @param pat the metacharacter pattern
+ * @param info returns literal strings for the pattern
+ */
+static void analyzeMetacharPattern( Pattern *pat, LiteralInfo *info )
+{
+  MetacharPattern *this = (MetacharPattern *) pat;
+
+  if ( this->metachar == '.' ) {
+    noLiteral( info );
   } else {
-    this->table[ pat->len ][ pat->len ] = true;
+    exactLiteral( info, "" );
   }
 }
 
@@ -237,8 +878,15 @@ static void locateMetacharPattern( Pattern *pat, char const *str )
 Pattern *makeMetacharPattern( char metachar )
 {
   MetacharPattern *this = (MetacharPattern *) malloc( sizeof( MetacharPattern ) );
-  this->table = NULL;
+  clearTable( (Pattern *) this );
+  this->kind = METACHAR_PATTERN;
   this->locate = locateMetacharPattern;
+  this->search = searchTable;
+  this->test = testTable;
+  this->compile = compileMetacharPattern;
+  this->visit = visitSimplePattern;
+  this->clone = cloneMetacharPattern;
+  this->analyze = analyzeMetacharPattern;
   this->destroy = destroySimplePattern;
   this->metachar = metachar;
   
@@ -249,13 +897,27 @@ Pattern *makeMetacharPattern( char metachar )
 /** Pattern that represents the character class. */
 typedef struct {
   // Fields from our superclass.
+  PatternKind kind;
   int len;
-  bool **table;
+  uint64_t *table;
+  int words;
+  size_t capacity;
+  PatternStats stats;
   void (*locate)( Pattern *pat, char const *str );
+  bool (*search)( Pattern *pat, int from, int *begin, int *end );
+  bool (*test)( Pattern *pat, char const *str );
+  int (*compile)( Pattern *pat, Nfa *nfa, int next );
+  void (*visit)( Pattern *pat, void (*fn)( Pattern *pat, void *data ),
+                 void *data );
+  Pattern *(*clone)( Pattern *pat );
+  void (*analyze)( Pattern *pat, LiteralInfo *info );
   void (*destroy)( Pattern *pat );
   
   /** The character class this pattern is supposed to match. */
   char *cclass;
+
+  /** Characters matched by the class, worked out when it's made. */
+  CharSet members;
 } CharClassPattern;
 
 /** The overridden destroy() function used for CharacterClassPattern. */
@@ -272,21 +934,16 @@ static void destroyCharClassPattern( Pattern *pat )
 }
 
 /**
- * Method that finds a single occurrence of a character that corresponds
- * any character from the character class. This method is an overridden
- * locate() method for the CharClassPattern.
+ * Method that reports whether a single character belongs to the
+ * character class. The class can contain ranges (Ex. a-z), and it's
+ * inverted if it starts with a '^'.
  *
- * @param pat the character class pattern
- * @param str the string to find a match for
+ * @param this the character class pattern
+ * @param c the character to check
+ * @return true if c is one of the characters matched by the class
  */
-static void locateCharClassPattern( Pattern *pat, char const *str )
+static bool inCharClass( CharClassPattern *this, char c )
 {
-  // Cast down to the struct type pat really points to.
-  CharClassPattern *this = (CharClassPattern *) pat;
-
-  // Make a fresh table for this input string.
-  initTable( pat, str );
-  
   //First, check if there is a ^ at the beginning of a character class.
   bool inverted = false;
   if ( this->cclass[ 0 ] == '^' && strlen( this->cclass ) != 1 ) {
@@ -294,57 +951,130 @@ static void locateCharClassPattern( Pattern *pat, char const *str )
   }
   
   if ( !inverted ) {
-    for ( int begin = 0; str[ begin ]; begin++ ) {
-      for ( int i = 0; this->cclass[ i ]; i++ ) {
-        if ( str[ begin ] == this->cclass[ i ] ) {
-          if ( str[ begin ] == '-' && this->cclass[ i ] == '-' ) {
-            if ( !( i - 1 >= 1 && i + 1 <= strlen( this->cclass ) - 1 ) ) {
-              this->table[ begin ][ begin + 1 ] = true;
-              break;
-            }
-          } else {
-            this->table[ begin ][ begin + 1 ] = true;
-            break;
+    for ( int i = 0; this->cclass[ i ]; i++ ) {
+      if ( c == this->cclass[ i ] ) {
+        if ( c == '-' && this->cclass[ i ] == '-' ) {
+          if ( !( i - 1 >= 1 && i + 1 <= strlen( this->cclass ) - 1 ) ) {
+            return true;
           }
-        } else if ( this->cclass[ i ] == '-' ) {
-          if ( i - 1 >= 0 && i + 1 <= strlen( this->cclass ) ) {
-            if ( str[ begin ] >= this->cclass[ i - 1 ]
-                 && str[ begin ] <= this->cclass[ i + 1 ] ) {
-              this->table[ begin ][ begin + 1 ] = true;
-              break;
-            }
+        } else {
+          return true;
+        }
+      } else if ( this->cclass[ i ] == '-' ) {
+        if ( i - 1 >= 0 && i + 1 <= strlen( this->cclass ) ) {
+          if ( c >= this->cclass[ i - 1 ] && c <= this->cclass[ i + 1 ] ) {
+            return true;
           }
         }
       }
     }
+    return false;
   } else {
-    for ( int begin = 0; str[ begin ]; begin++ ) {
-      bool foundMatch = false;
-      for ( int i = 1; this->cclass[ i ]; i++ ) {
-        if ( str[ begin ] == this->cclass[ i ] ) {
-          if ( str[ begin ] == '-' && this->cclass[ i ] == '-' ) {
-            if ( this->cclass[ i - 1 ] == '^' ) {
-              foundMatch = true;
-              break;
-            }
-          } else {
-            foundMatch = true;
-            break;
+    for ( int i = 1; this->cclass[ i ]; i++ ) {
+      if ( c == this->cclass[ i ] ) {
+        if ( c == '-' && this->cclass[ i ] == '-' ) {
+          if ( this->cclass[ i - 1 ] == '^' ) {
+            return false;
           }
-        } else if ( this->cclass[ i ] == '-' ) {
-          if ( i - 1 >= 1 && i + 1 <= strlen( this->cclass ) ) {
-            if ( str[ begin ] >= this->cclass[ i - 1 ]
-                 && str[ begin ] <= this->cclass[ i + 1 ] ) {
-              foundMatch = true;
-              break;
-            }
+        } else {
+          return false;
+        }
+      } else if ( this->cclass[ i ] == '-' ) {
+        if ( i - 1 >= 1 && i + 1 <= strlen( this->cclass ) ) {
+          if ( c >= this->cclass[ i - 1 ] && c <= this->cclass[ i + 1 ] ) {
+            return false;
           }
         }
       }
-      if ( !foundMatch ) {
-        this->table[ begin ][ begin + 1 ] = true;
+    }
+    return true;
+  }
+}
+
+/**
+ * Method that finds a single occurrence of a character that corresponds
+ * any character from the character class. This method is an overridden
+ * locate() method for the CharClassPattern.
+ *
+ * @param pat the character class pattern
+ * @param str the string to find a match for
+ */
+static void locateCharClassPattern( Pattern *pat, char const *str )
+{
+  // Cast down to the struct type pat really points to.
+  CharClassPattern *this = (CharClassPattern *) pat;
+
+  // Make a fresh table for this input string.
+  initTable( pat, str );
+
+  findInSet( &this->members, str, pat->len, tableRow( pat, pat->len ) );
+  setSingleMatches( pat );
+}
+
+/**
+ * Method that adds a state to an automaton that consumes any single
+ * character from the character class. This method is an overridden
+ * compile() method for the CharClassPattern.
+ *
+ * @param pat the character class pattern
+ * @param nfa the automaton to add states to
+ * @param next the state to move to after a match
+ * @return the first state for this pattern
+ */
+static int compileCharClassPattern( Pattern *pat, Nfa *nfa, int next )
+{
+  CharClassPattern *this = (CharClassPattern *) pat;
+
+  return addCharState( nfa, &this->members, next );
+}
+
+/**
+ * Method that creates a character class pattern for a set of characters
+ * that's already worked out, e.g., by the optimizer.
+ *
+ * @param members the characters the class should match
+ * @return a dynamically allocated representation for the character class
+ * pattern
+ */
+static Pattern *makeCharSetPattern( CharSet const *members )
+{
+  // An empty class string has no members, then we fill them in.
+  CharClassPattern *this = (CharClassPattern *) makeCharClassPattern( "" );
+  this->members = *members;
+  return (Pattern *) this;
+}
+
+/** The overridden clone() function used for CharClassPattern. */
+static Pattern *cloneCharClassPattern( Pattern *pat )
+{
+  CharClassPattern *this = (CharClassPattern *) pat;
+
+  return makeCharSetPattern( &this->members );
+}
+
+/**
+ * Method that finds literal strings required by the character class.
+ * A class with just one member is the same as that symbol. This method
+ * is an overridden analyze() method for the CharClassPattern.
+ *
+ * @param pat the character class pattern
+ * @param info returns literal strings for the pattern
+ */
+static void analyzeCharClassPattern( Pattern *pat, LiteralInfo *info )
+{
+  CharClassPattern *this = (CharClassPattern *) pat;
+
+  if ( csetCount( &this->members ) == 1 ) {
+    char member = '\0';
+    for ( int c = 1; c < CSET_WORDS * CSET_WORD_BITS; c++ ) {
+      if ( CSET_HAS( &this->members, c ) ) {
+        member = (char) c;
       }
     }
+    char str[] = { member, '\0' };
+    exactLiteral( info, str );
+  } else {
+    noLiteral( info );
   }
 }
 
@@ -352,8 +1082,15 @@ static void locateCharClassPattern( Pattern *pat, char const *str )
 Pattern *makeCharClassPattern( char *str )
 {
   CharClassPattern *this = (CharClassPattern *) malloc( sizeof( CharClassPattern ) );
-  this->table = NULL;
+  clearTable( (Pattern *) this );
+  this->kind = CHAR_CLASS_PATTERN;
   this->locate = locateCharClassPattern;
+  this->search = searchTable;
+  this->test = testTable;
+  this->compile = compileCharClassPattern;
+  this->visit = visitSimplePattern;
+  this->clone = cloneCharClassPattern;
+  this->analyze = analyzeCharClassPattern;
   this->destroy = destroyCharClassPattern;
   
   this->cclass = (char *) malloc( strlen( str ) + 1 );
@@ -361,15 +1098,55 @@ Pattern *makeCharClassPattern( char *str )
     this->cclass[ i ] = str[ i ];
   }
   this->cclass[ strlen( str ) ] = '\0';
+
+  // Work out the members of the class once, so matching is just a lookup.
+  csetClear( &this->members );
+  for ( int c = 1; c < CSET_WORDS * CSET_WORD_BITS; c++ ) {
+    if ( inCharClass( this, (char) c ) ) {
+      csetAdd( &this->members, c );
+    }
+  }
+  return (Pattern *) this;
+}
+
+// Documented in header.
+Pattern *makeFoldedCharClassPattern( char *str )
+{
+  CharClassPattern *this = (CharClassPattern *) makeCharClassPattern( str );
+
+  // In folded input, a lowercase letter stands for both cases, so it's
+  // a member if either case is, or if both are, for an inverted class.
+  bool inverted = str[ 0 ] == '^' && str[ 1 ];
+  for ( int c = 'a'; c <= 'z'; c++ ) {
+    int upper = c - 'a' + 'A';
+    bool lower = CSET_HAS( &this->members, c );
+    bool capital = CSET_HAS( &this->members, upper );
+    if ( inverted ? lower && capital : lower || capital )
+      csetAdd( &this->members, c );
+    else
+      csetRemove( &this->members, c );
+    csetRemove( &this->members, upper );
+  }
   return (Pattern *) this;
 }
 
 /** Pattern that represents the alternation between two pattern types. */
 typedef struct {
   // Fields from our superclass.
+  PatternKind kind;
   int len;
-  bool **table;
+  uint64_t *table;
+  int words;
+  size_t capacity;
+  PatternStats stats;
   void (*locate)( Pattern *pat, char const *str );
+  bool (*search)( Pattern *pat, int from, int *begin, int *end );
+  bool (*test)( Pattern *pat, char const *str );
+  int (*compile)( Pattern *pat, Nfa *nfa, int next );
+  void (*visit)( Pattern *pat, void (*fn)( Pattern *pat, void *data ),
+                 void *data );
+  Pattern *(*clone)( Pattern *pat );
+  void (*analyze)( Pattern *pat, LiteralInfo *info );
   void (*destroy)( Pattern *pat );
   
   /** Pointers to the two sub patterns. */
@@ -391,10 +1168,22 @@ static void destroyAlternationPattern( Pattern *pat )
   free( this );
 }
 
+/** The overridden visit() function used for AlternationPattern. */
+static void visitAlternationPattern( Pattern *pat,
+                                     void (*fn)( Pattern *pat, void *data ),
+                                     void *data )
+{
+  AlternationPattern *this = (AlternationPattern *) pat;
+
+  this->p1->visit( this->p1, fn, data );
+  this->p2->visit( this->p2, fn, data );
+  fn( pat, data );
+}
+
 /**
- * Method that finds a match for a given string based on the two
- * pattern types that the AlternationPattern supports. This method
- * is an overridden locate() method for the AlternationPattern.
+ * Method that finds every substring matched by either of the two sub
+ * patterns. This method is an overridden locate() method for the
+ * AlternationPattern.
  *
  * @param pat the alternation pattern
  * @param str the string to find a match for
@@ -409,32 +1198,100 @@ static void locateAlternationPattern( Pattern *pat, const char *str )
   this->p1->locate( this->p1, str );
   this->p2->locate( this->p2, str );
   
-  bool foundMatch = false;
-  for ( int begin = 0; begin <= this->len; begin++ ) {
-    for ( int end = begin; end <= this->len; end++ ) {
-      if ( matches( this->p1, begin, end ) ) {
-        foundMatch = true;
-      }
-    }
+  // Our table is the union of theirs.  The tables are stored in one
+  // block, so we can or them together like one long row.
+  int size = ( this->len + 1 ) * this->words;
+  orRow( this->table, this->p1->table, size );
+  orRow( this->table, this->p2->table, size );
+}
+
+/**
+ * Method that checks for a match of either sub pattern, without
+ * filling in our own table. If the first one matches, the second
+ * doesn't have to be checked at all. This method is an overridden
+ * test() method for the AlternationPattern.
+ *
+ * @param pat the alternation pattern
+ * @param str the string to check
+ * @return true if the pattern matches anywhere in str
+ */
+static bool testAlternationPattern( Pattern *pat, char const *str )
+{
+  AlternationPattern *this = (AlternationPattern *) pat;
+
+  return this->p1->test( this->p1, str ) || this->p2->test( this->p2, str );
+}
+
+/**
+ * Method that adds states to an automaton that can move into the
+ * states for either of the two sub patterns. This method is an
+ * overridden compile() method for the AlternationPattern.
+ *
+ * @param pat the alternation pattern
+ * @param nfa the automaton to add states to
+ * @param next the state to move to after a match
+ * @return the first state for this pattern
+ */
+static int compileAlternationPattern( Pattern *pat, Nfa *nfa, int next )
+{
+  AlternationPattern *this = (AlternationPattern *) pat;
+
+  int first = this->p1->compile( this->p1, nfa, next );
+  int second = this->p2->compile( this->p2, nfa, next );
+  return addSplitState( nfa, first, second );
+}
+
+/** The overridden clone() function used for AlternationPattern. */
+static Pattern *cloneAlternationPattern( Pattern *pat )
+{
+  AlternationPattern *this = (AlternationPattern *) pat;
+
+  return makeAlternationPattern( this->p1->clone( this->p1 ),
+                                 this->p2->clone( this->p2 ) );
+}
+
+/**
+ * Method that finds literal strings required by the alternation
+ * pattern. A match only has to contain what both sub patterns have
+ * in common, so this keeps the common start of their prefixes and the
+ * common end of their suffixes. This method is an overridden analyze()
+ * method for the AlternationPattern.
+ *
+ * @param pat the alternation pattern
+ * @param info returns literal strings for the pattern
+ */
+static void analyzeAlternationPattern( Pattern *pat, LiteralInfo *info )
+{
+  AlternationPattern *this = (AlternationPattern *) pat;
+
+  LiteralInfo a, b;
+  this->p1->analyze( this->p1, &a );
+  this->p2->analyze( this->p2, &b );
+
+  info->exact = NULL;
+  if ( a.exact && b.exact && strcmp( a.exact, b.exact ) == 0 ) {
+    info->exact = copyString( a.exact );
   }
-  
-  if ( foundMatch ) {
-    for ( int begin = 0; begin <= this->len; begin++ ) {
-      for ( int end = begin; end <= this->len; end++ ) {
-        if ( matches( this->p1, begin, end ) ) {
-          this->table[ begin ][ end ] = true;
-        }
-      }
-    }
-  } else {
-    for ( int begin = 0; begin <= this->len; begin++ ) {
-      for ( int end = begin; end <= this->len; end++ ) {
-        if ( matches( this->p2, begin, end ) ) {
-          this->table[ begin ][ end ] = true;
-        }
-      }
-    }
+
+  int n = 0;
+  while ( a.prefix[ n ] && a.prefix[ n ] == b.prefix[ n ] ) {
+    n++;
   }
+  info->prefix = copyString( a.prefix );
+  info->prefix[ n ] = '\0';
+
+  int alen = strlen( a.suffix );
+  int blen = strlen( b.suffix );
+  n = 0;
+  while ( n < alen && n < blen
+          && a.suffix[ alen - n - 1 ] == b.suffix[ blen - n - 1 ] ) {
+    n++;
+  }
+  info->suffix = copyString( a.suffix + alen - n );
+
+  info->required = copyString( longerString( info->prefix, info->suffix ) );
+  freeLiteralInfo( &a );
+  freeLiteralInfo( &b );
 }
 
 // Documented in header.
@@ -442,31 +1299,68 @@ Pattern *makeAlternationPattern( Pattern *p1, Pattern *p2 )
 {
   // Make an instance of Binary pattern and fill in its fields.
   AlternationPattern *this = (AlternationPattern *) malloc( sizeof( AlternationPattern ) );
-  this->table = NULL;
+  clearTable( (Pattern *) this );
   this->p1 = p1;
   this->p2 = p2;
   
+  this->kind = ALTERNATION_PATTERN;
   this->locate = locateAlternationPattern;
+  this->search = searchTable;
+  this->test = testAlternationPattern;
+  this->compile = compileAlternationPattern;
+  this->visit = visitAlternationPattern;
+  this->clone = cloneAlternationPattern;
+  this->analyze = analyzeAlternationPattern;
   this->destroy = destroyAlternationPattern;
   
   return (Pattern *) this;
 }
 
+// Documented in header.
+Pattern *makeAlternationList( Pattern **pats, int count )
+{
+  if ( count == 1 )
+    return pats[ 0 ];
+
+  int half = count / 2;
+  return makeAlternationPattern( makeAlternationList( pats, half ),
+                                 makeAlternationList( pats + half,
+                                                      count - half ) );
+}
+
 /**
  * Pattern that represents the repetition pattern. The repetition pattern
- * can either be represented as a '+', '*', or a '?'.
+ * can either be represented as a '+', '*', '?' or a {m,n} range.
  */
 typedef struct {
   // Fields from our superclass.
+  PatternKind kind;
   int len;
-  bool **table;
+  uint64_t *table;
+  int words;
+  size_t capacity;
+  PatternStats stats;
   void (*locate)( Pattern *pat, char const *str );
+  bool (*search)( Pattern *pat, int from, int *begin, int *end );
+  bool (*test)( Pattern *pat, char const *str );
+  int (*compile)( Pattern *pat, Nfa *nfa, int next );
+  void (*visit)( Pattern *pat, void (*fn)( Pattern *pat, void *data ),
+                 void *data );
+  Pattern *(*clone)( Pattern *pat );
+  void (*analyze)( Pattern *pat, LiteralInfo *info );
   void (*destroy)( Pattern *pat );
   
   /** The pointer to the pattern being matched. */
   Pattern *pat;
-  /** The character representation of the repetition pattern. */
-  char *rpat;
+  /** The minimum number of occurrences. */
+  int min;
+  /** The maximum number of occurrences, or -1 if there's no maximum. */
+  int max;
+
+  /** Scratch tables used to count occurrences, kept between lines. */
+  uint64_t *work;
+  /** Number of words allocated for the scratch tables. */
+  int workCapacity;
 } RepetitionPattern;
 
 /** The overridden destroy() function used for RepetitionPattern. */
@@ -477,10 +1371,185 @@ static void destroyRepetitionPattern( Pattern *pat )
 
   freeTable( pat );
   this->pat->destroy( this->pat );
-  free( this->rpat );
+  free( this->work );
   free( this );
 }
 
+/** The overridden visit() function used for RepetitionPattern. */
+static void visitRepetitionPattern( Pattern *pat,
+                                    void (*fn)( Pattern *pat, void *data ),
+                                    void *data )
+{
+  RepetitionPattern *this = (RepetitionPattern *) pat;
+
+  this->pat->visit( this->pat, fn, data );
+  fn( pat, data );
+}
+
+/**
+ * Method that fills in the repetition pattern's table with every
+ * substring made of one or more consecutive matches of the sub pattern.
+ * Rows are filled from the end of the string back to the start, so
+ * whenever a sub pattern match starting at begin ends at k, row k is
+ * already complete and can be or-ed into row begin a word at a time.
+ *
+ * @param this the repetition pattern
+ * @param empty true if the empty string should also match
+ */
+static void closeTable( RepetitionPattern *this, bool empty )
+{
+  Pattern *pat = (Pattern *) this;
+  for ( int begin = this->len; begin >= 0; begin-- ) {
+    uint64_t *row = tableRow( pat, begin );
+    uint64_t *sub = tableRow( this->pat, begin );
+    orRow( row, sub, this->words );
+    for ( int w = 0; w < this->words; w++ ) {
+      for ( uint64_t bits = sub[ w ]; bits; bits &= bits - 1 ) {
+        int k = w * WORD_BITS + __builtin_ctzll( bits );
+        if ( k > begin ) {
+          orRow( row, tableRow( pat, k ), this->words );
+        }
+      }
+    }
+    if ( empty ) {
+      setMatch( pat, begin, begin );
+    }
+  }
+}
+
+/**
+ * Method that fills in a table with every substring made of a match
+ * from the left table followed by a match from the right table. Each
+ * match in row begin of the left table that ends at k pulls in row k
+ * of the right table, a word at a time.
+ *
+ * @param dest the table to fill in
+ * @param left the table for the first part of each substring
+ * @param right the table for the second part of each substring
+ * @param len the length of the string the tables are for
+ * @param words the number of words in each table row
+ */
+static void composeTables( uint64_t *dest, uint64_t const *left,
+                           uint64_t const *right, int len, int words )
+{
+  memset( dest, 0, ( len + 1 ) * words * sizeof( uint64_t ) );
+  for ( int begin = 0; begin <= len; begin++ ) {
+    uint64_t const *row = left + begin * words;
+    for ( int w = 0; w < words; w++ ) {
+      for ( uint64_t bits = row[ w ]; bits; bits &= bits - 1 ) {
+        int k = w * WORD_BITS + __builtin_ctzll( bits );
+        orRow( dest + begin * words, right + k * words, words );
+      }
+    }
+  }
+}
+
+/**
+ * Method that sets the cell for the empty match at every position of
+ * a table, so it matches zero occurrences of anything.
+ *
+ * @param table the table to add empty matches to
+ * @param len the length of the string the table is for
+ * @param words the number of words in each table row
+ */
+static void addEmptyMatches( uint64_t *table, int len, int words )
+{
+  for ( int begin = 0; begin <= len; begin++ ) {
+    table[ begin * words + begin / WORD_BITS ] |=
+      (uint64_t) 1 << ( begin % WORD_BITS );
+  }
+}
+
+/**
+ * Method that fills in a table with every substring made of exactly
+ * count consecutive matches from another table. This takes a number of
+ * compositions logarithmic in count, by squaring the source table. If
+ * the source table has all the empty matches, its powers stop growing
+ * once squaring doesn't change them, so that ends the work early.
+ *
+ * @param dest the table to fill in
+ * @param src the table for a single occurrence
+ * @param count the number of occurrences
+ * @param base scratch table, the same size as dest
+ * @param temp scratch table, the same size as dest
+ * @param len the length of the string the tables are for
+ * @param words the number of words in each table row
+ */
+static void powerTable( uint64_t *dest, uint64_t const *src, int count,
+                        uint64_t *base, uint64_t *temp, int len, int words )
+{
+  size_t bytes = ( len + 1 ) * words * sizeof( uint64_t );
+  bool reflexive = true;
+  for ( int begin = 0; begin <= len; begin++ ) {
+    if ( !( ( src[ begin * words + begin / WORD_BITS ] >>
+              ( begin % WORD_BITS ) ) & 1 ) ) {
+      reflexive = false;
+    }
+  }
+
+  memset( dest, 0, bytes );
+  addEmptyMatches( dest, len, words );
+  memcpy( base, src, bytes );
+  while ( count ) {
+    if ( count & 1 ) {
+      composeTables( temp, dest, base, len, words );
+      memcpy( dest, temp, bytes );
+    }
+    count >>= 1;
+    if ( count ) {
+      composeTables( temp, base, base, len, words );
+      if ( reflexive && memcmp( temp, base, bytes ) == 0 ) {
+        // Every higher power is the same as this one.
+        composeTables( temp, dest, base, len, words );
+        memcpy( dest, temp, bytes );
+        return;
+      }
+      memcpy( base, temp, bytes );
+    }
+  }
+}
+
+/**
+ * Method that fills in the repetition pattern's table for a {m,n}
+ * range. It's the table for exactly min consecutive occurrences of the
+ * sub pattern, followed by either the closure of the sub pattern (if
+ * there's no maximum) or up to max - min more occurrences.
+ *
+ * @param this the repetition pattern
+ */
+static void countTable( RepetitionPattern *this )
+{
+  Pattern *pat = (Pattern *) this;
+  int size = ( this->len + 1 ) * this->words;
+  if ( 4 * size > this->workCapacity ) {
+    free( this->work );
+    this->workCapacity = 4 * size;
+    this->work = (uint64_t *) malloc( this->workCapacity * sizeof( uint64_t ) );
+    this->stats.bytes += this->workCapacity * sizeof( uint64_t );
+  }
+  uint64_t *required = this->work;
+  uint64_t *optional = required + size;
+  uint64_t *base = optional + size;
+  uint64_t *temp = base + size;
+
+  powerTable( required, this->pat->table, this->min, base, temp,
+              this->len, this->words );
+
+  if ( this->max == -1 ) {
+    closeTable( this, true );
+    memcpy( optional, tableRow( pat, 0 ), size * sizeof( uint64_t ) );
+  } else {
+    // Each extra occurrence can match the sub pattern or nothing.
+    // Our own table holds this step until the final result goes in it.
+    memcpy( tableRow( pat, 0 ), this->pat->table, size * sizeof( uint64_t ) );
+    addEmptyMatches( tableRow( pat, 0 ), this->len, this->words );
+    powerTable( optional, tableRow( pat, 0 ), this->max - this->min, base,
+                temp, this->len, this->words );
+  }
+  composeTables( tableRow( pat, 0 ), required, optional,
+                 this->len, this->words );
+}
+
 /**
  * Method finds 0, 1, or multiple occurrences of a character
  * from the given string, depending on the repetition pattern.
@@ -496,156 +1565,1899 @@ static void locateRepetitionPattern( Pattern *pat, char const *str )
 
   // Make a fresh table for this input string.
   initTable( pat, str );
+  this->pat->locate( this->pat, str );
   
-  if ( this->rpat[ 0 ] == '*' ) {
-    this->pat->locate( this->pat, str );
-    for ( int begin = 0; begin <= this->len; begin++ ) {
-      for ( int end = begin; end <= this->len; end++ ) {
-        if ( matches( this->pat, begin, end ) ) {
-          this->table[ begin ][ end ] = true;
-          if ( end != this->len && ( matches( this->pat, begin, end )
-                 && matches( this->pat, begin + 1, end + 1 ) ) ) {
-            this->table[ begin ][ end + 1 ] = true;
-          }
-        } else if ( begin == end ) {
-          this->table[ begin ][ end ] = true;
-        }
-      }
-    }
-    for ( int begin = 0; begin <= this->len; begin++ ) {
-      for ( int end = begin; end <= this->len; end++ ) {
-        for ( int k = begin; k <= end; k++ ) {
-          if ( this->table[ begin ][ k ] && this->table[ k ][ end ] ) {
-            this->table[ begin ][ end ] = true;
-          }
-        }
-      }
-    }
-  } else if ( this->rpat[ 0 ] == '+' ) {
-    //SymbolPattern *temp = (SymbolPattern *) this->pat;
-    //str[ begin ] == temp->sym
-    this->pat->locate( this->pat, str );
-    for ( int begin = 0; begin <= this->len; begin++ ) {
-      for ( int end = begin; end <= this->len; end++ ) {
-        if ( matches( this->pat, begin, end ) ) {
-          this->table[ begin ][ end ] = true;
-          if ( end != this->len && ( matches( this->pat, begin, end )
-                 && matches( this->pat, begin + 1, end + 1 ) ) ) {
-            this->table[ begin ][ end + 1 ] = true;
-          }
-        }
-      }
-    }
-    for ( int begin = 0; begin <= this->len; begin++ ) {
-      for ( int end = begin; end <= this->len; end++ ) {
-        for ( int k = begin; k <= end; k++ ) {
-          if ( this->table[ begin ][ k ] && this->table[ k ][ end ] ) {
-            this->table[ begin ][ end ] = true;
-          }
-        }
-      }
-    }
-  } else if ( this->rpat[ 0 ] == '?' ) {
-    this->pat->locate( this->pat, str );
-    for ( int begin = 0; begin <= this->len; begin++ ) {
-      for ( int end = begin; end <= this->len; end++ ) {
-        if ( matches( this->pat, begin, end ) ) {
-          this->table[ begin ][ end ] = true;
-        } else if ( begin == end ) {
-          this->table[ begin ][ end ] = true;
-        }
-      }
-    }
+  // Closures are filled in directly, everything else is counted.
+  if ( this->max == -1 && this->min <= 1 ) {
+    closeTable( this, this->min == 0 );
   } else {
-    this->pat->locate( this->pat, str );
-    //We know the first and last positions of the sequence is a '{'
-    //and a '}', respectively. So, we need to first find the comma
-    //and then check which types of consecutive occurrences to consider.
-    int start;
-    int end;
-    for ( int i = 0; this->rpat[ i ]; i++ ) {
-      if ( this->rpat[ i ] == ',' ) {
-        if ( this->rpat[ i - 1 ] == '{' ) {
-          start = 0;
-        } else {
-          start = (int) this->rpat[ i - 1 ];
-        }
-        if ( this->rpat[ i + 1 ] == '}' ) {
-          //This negative value is used to represent m (infinitely many)
-          //possible occurrences.
-          end = -1;
-        } else {
-          end = (int) this->rpat[ i + 1 ];
-        }
-        break;
-      }
-    }
-    
-    //Once we have got the integer values (start and end), we should
-    //then find any matches and keep track of the number of matches
-    //we've found.
-    int count = 0;
-    for ( int begin = 0; begin <= this->len; begin++ ) {
-      for ( int end = begin; end <= this->len; end++ ) {
-        if ( matches( this->pat, begin, end ) ) {
-            count++;
-        }
-      }
-    }
-    
-    //Now, compare the count to the start and end values. If the count
-    //value is not between the start and end values, then don't iterate
-    //through the match table anymore. Otherwise, iterate through the
-    //table and mark the appropriate location with the appropriate value.
-    bool isValid = false;
-    if ( end == -1 ) {
-      if ( count >= start ) {
-        isValid = true;
-      }
-    } else {
-      if ( count >= start && count <= end ) {
-        isValid = true;
-      }
-    }
-    if ( isValid ) {
-      for ( int begin = 0; begin <= this->len; begin++ ) {
-        for ( int end = begin; end <= this->len; end++ ) {
-          if ( matches( this->pat, begin, end ) ) {
-            this->table[ begin ][ end ] = true;
-            if ( end != this->len && ( matches( this->pat, begin, end )
-                 && matches( this->pat, begin + 1, end + 1 ) ) ) {
-              this->table[ begin ][ end + 1 ] = true;
-            }
-          } else if ( begin == end && start == 0 ) {
-            this->table[ begin ][ end ] = true;
-          }
-        }
-      }
-      for ( int begin = 0; begin <= this->len; begin++ ) {
-        for ( int end = begin; end <= this->len; end++ ) {
-          for ( int k = begin; k <= end; k++ ) {
-            if ( this->table[ begin ][ k ] && this->table[ k ][ end ] ) {
-              this->table[ begin ][ end ] = true;
-            }
-          }
-        }
-      }
-    }
+    countTable( this );
   }
 }
 
-// Documented in header.
-Pattern *makeRepetitionPattern( Pattern *pat, char *rpat )
+/**
+ * Method that adds states to an automaton for the repetition pattern.
+ * The required occurrences are unrolled into copies of the sub pattern,
+ * followed by either a loop (if there's no maximum) or a chain of
+ * optional copies. This method is an overridden compile() method for
+ * the RepetitionPattern.
+ *
+ * @param pat the repetition pattern
+ * @param nfa the automaton to add states to
+ * @param next the state to move to after a match
+ * @return the first state for this pattern
+ */
+static int compileRepetitionPattern( Pattern *pat, Nfa *nfa, int next )
 {
-  RepetitionPattern *this = (RepetitionPattern *) malloc( sizeof( RepetitionPattern ) );
-  this->table = NULL;
-  this->locate = locateRepetitionPattern;
-  this->destroy = destroyRepetitionPattern;
-  this->pat = pat;
-  this->rpat = (char *) malloc( strlen( rpat ) + 1 );
-  for ( int i = 0; rpat[ i ]; i++ ) {
-    this->rpat[ i ] = rpat[ i ];
+  RepetitionPattern *this = (RepetitionPattern *) pat;
+  int min = this->min;
+  int max = this->max;
+
+  int first = next;
+  if ( max == -1 ) {
+    // Loop back through a split state that can either repeat the
+    // sub pattern or leave.
+    int loop = addSplitState( nfa, -1, next );
+    // Compiling can move the states, so look up the loop state after.
+    int body = this->pat->compile( this->pat, nfa, loop );
+    nfa->states[ loop ].out = body;
+    first = loop;
+  } else {
+    for ( int i = min; i < max; i++ ) {
+      int body = this->pat->compile( this->pat, nfa, first );
+      first = addSplitState( nfa, body, next );
+    }
+  }
+
+  for ( int i = 0; i < min; i++ )
+    first = this->pat->compile( this->pat, nfa, first );
+  return first;
+}
+
+/** The overridden clone() function used for RepetitionPattern. */
+static Pattern *cloneRepetitionPattern( Pattern *pat )
+{
+  RepetitionPattern *this = (RepetitionPattern *) pat;
+
+  return makeRepetitionPattern( this->pat->clone( this->pat ), this->min,
+                                this->max );
+}
+
+/**
+ * Method that finds literal strings required by the repetition
+ * pattern. If there has to be at least one occurrence, a match starts,
+ * ends and contains whatever the sub pattern's matches do. This method
+ * is an overridden analyze() method for the RepetitionPattern.
+ *
+ * @param pat the repetition pattern
+ * @param info returns literal strings for the pattern
+ */
+static void analyzeRepetitionPattern( Pattern *pat, LiteralInfo *info )
+{
+  RepetitionPattern *this = (RepetitionPattern *) pat;
+  int min = this->min;
+  int max = this->max;
+
+  if ( min < 1 ) {
+    noLiteral( info );
+    return;
+  }
+
+  LiteralInfo sub;
+  this->pat->analyze( this->pat, &sub );
+  info->exact = NULL;
+  if ( sub.exact && min == 1 && max == 1 ) {
+    info->exact = copyString( sub.exact );
+  }
+  info->prefix = copyString( sub.prefix );
+  info->suffix = copyString( sub.suffix );
+  info->required = copyString( sub.required );
+  freeLiteralInfo( &sub );
+}
+
+// Documented in header.
+Pattern *makeRepetitionPattern( Pattern *pat, int min, int max )
+{
+  RepetitionPattern *this = (RepetitionPattern *) malloc( sizeof( RepetitionPattern ) );
+  clearTable( (Pattern *) this );
+  this->kind = REPETITION_PATTERN;
+  this->locate = locateRepetitionPattern;
+  this->search = searchTable;
+  this->test = testTable;
+  this->compile = compileRepetitionPattern;
+  this->visit = visitRepetitionPattern;
+  this->clone = cloneRepetitionPattern;
+  this->analyze = analyzeRepetitionPattern;
+  this->destroy = destroyRepetitionPattern;
+  this->pat = pat;
+  this->min = min;
+  this->max = max;
+  this->work = NULL;
+  this->workCapacity = 0;
+  
+  return (Pattern *) this;
+}
+
+/**
+ * Pattern for a parenthesized group whose match is captured, so the
+ * part of a match it covers can be reported.  It matches the same
+ * substrings as the pattern inside it.  Captures are only found with an
+ * automaton, where the group records its boundaries in two capture
+ * slots.
+ */
+typedef struct {
+  // Fields from our superclass.
+  PatternKind kind;
+  int len;
+  uint64_t *table;
+  int words;
+  size_t capacity;
+  PatternStats stats;
+  void (*locate)( Pattern *pat, char const *str );
+  bool (*search)( Pattern *pat, int from, int *begin, int *end );
+  bool (*test)( Pattern *pat, char const *str );
+  int (*compile)( Pattern *pat, Nfa *nfa, int next );
+  void (*visit)( Pattern *pat, void (*fn)( Pattern *pat, void *data ),
+                 void *data );
+  Pattern *(*clone)( Pattern *pat );
+  void (*analyze)( Pattern *pat, LiteralInfo *info );
+  void (*destroy)( Pattern *pat );
+
+  /** The pattern inside the group. */
+  Pattern *pat;
+  /** Number of the group, counting opening parentheses from 1. */
+  int group;
+} CapturePattern;
+
+/** The overridden destroy() function used for CapturePattern. */
+static void destroyCapturePattern( Pattern *pat )
+{
+  CapturePattern *this = (CapturePattern *) pat;
+
+  freeTable( pat );
+  this->pat->destroy( this->pat );
+  free( this );
+}
+
+/** The overridden visit() function used for CapturePattern. */
+static void visitCapturePattern( Pattern *pat,
+                                 void (*fn)( Pattern *pat, void *data ),
+                                 void *data )
+{
+  CapturePattern *this = (CapturePattern *) pat;
+
+  this->pat->visit( this->pat, fn, data );
+  fn( pat, data );
+}
+
+/**
+ * Method that fills in the capture pattern's table with a copy of the
+ * table for the pattern inside it. This method is an overridden
+ * locate() method for the CapturePattern.
+ *
+ * @param pat the capture pattern
+ * @param str the string to find matches in
+ */
+static void locateCapturePattern( Pattern *pat, char const *str )
+{
+  CapturePattern *this = (CapturePattern *) pat;
+
+  initTable( pat, str );
+  this->pat->locate( this->pat, str );
+  memcpy( tableRow( pat, 0 ), tableRow( this->pat, 0 ),
+          ( pat->len + 1 ) * pat->words * sizeof( uint64_t ) );
+}
+
+/**
+ * Method that adds states for the pattern inside the group, with save
+ * states before and after it to record where the group begins and
+ * ends. This method is an overridden compile() method for the
+ * CapturePattern.
+ *
+ * @param pat the capture pattern
+ * @param nfa the automaton to add states to
+ * @param next the state to move to after a match
+ * @return the first state for this pattern
+ */
+static int compileCapturePattern( Pattern *pat, Nfa *nfa, int next )
+{
+  CapturePattern *this = (CapturePattern *) pat;
+
+  int close = addSaveState( nfa, 2 * this->group + 1, next );
+  int body = this->pat->compile( this->pat, nfa, close );
+  return addSaveState( nfa, 2 * this->group, body );
+}
+
+/** The overridden clone() function used for CapturePattern. */
+static Pattern *cloneCapturePattern( Pattern *pat )
+{
+  CapturePattern *this = (CapturePattern *) pat;
+
+  return makeCapturePattern( this->pat->clone( this->pat ), this->group );
+}
+
+/** The overridden analyze() function used for CapturePattern. */
+static void analyzeCapturePattern( Pattern *pat, LiteralInfo *info )
+{
+  CapturePattern *this = (CapturePattern *) pat;
+
+  this->pat->analyze( this->pat, info );
+}
+
+// Documented in header.
+Pattern *makeCapturePattern( Pattern *pat, int group )
+{
+  CapturePattern *this = (CapturePattern *) malloc( sizeof( CapturePattern ) );
+  clearTable( (Pattern *) this );
+  this->kind = CAPTURE_PATTERN;
+  this->locate = locateCapturePattern;
+  this->search = searchTable;
+  this->test = testTable;
+  this->compile = compileCapturePattern;
+  this->visit = visitCapturePattern;
+  this->clone = cloneCapturePattern;
+  this->analyze = analyzeCapturePattern;
+  this->destroy = destroyCapturePattern;
+  this->pat = pat;
+  this->group = group;
+
+  return (Pattern *) this;
+}
+
+/**
+ * Pattern that matches by simulating an automaton compiled from a tree
+ * of other patterns, instead of filling in a match table.
+ */
+typedef struct {
+  // Fields from our superclass.
+  PatternKind kind;
+  int len;
+  uint64_t *table;
+  int words;
+  size_t capacity;
+  PatternStats stats;
+  void (*locate)( Pattern *pat, char const *str );
+  bool (*search)( Pattern *pat, int from, int *begin, int *end );
+  bool (*test)( Pattern *pat, char const *str );
+  int (*compile)( Pattern *pat, Nfa *nfa, int next );
+  void (*visit)( Pattern *pat, void (*fn)( Pattern *pat, void *data ),
+                 void *data );
+  Pattern *(*clone)( Pattern *pat );
+  void (*analyze)( Pattern *pat, LiteralInfo *info );
+  void (*destroy)( Pattern *pat );
+
+  /** The pattern this automaton was compiled from. */
+  Pattern *pat;
+  /** The compiled automaton. */
+  Nfa *nfa;
+  /** The most recent input string. */
+  char const *str;
+} AutomatonPattern;
+
+/** The overridden destroy() function used for AutomatonPattern. */
+static void destroyAutomatonPattern( Pattern *pat )
+{
+  AutomatonPattern *this = (AutomatonPattern *) pat;
+
+  this->pat->destroy( this->pat );
+  freeNfa( this->nfa );
+  free( this );
+}
+
+/** The overridden visit() function used for AutomatonPattern. */
+static void visitAutomatonPattern( Pattern *pat,
+                                   void (*fn)( Pattern *pat, void *data ),
+                                   void *data )
+{
+  AutomatonPattern *this = (AutomatonPattern *) pat;
+
+  this->pat->visit( this->pat, fn, data );
+  fn( pat, data );
+}
+
+/**
+ * Method that remembers the input string for later calls to search().
+ * There's no match table to fill in. This method is an overridden
+ * locate() method for the AutomatonPattern.
+ *
+ * @param pat the automaton pattern
+ * @param str the string to find matches in
+ */
+static void locateAutomatonPattern( Pattern *pat, char const *str )
+{
+  AutomatonPattern *this = (AutomatonPattern *) pat;
+
+  this->str = str;
+  this->len = strlen( str );
+}
+
+/**
+ * Method that finds the leftmost-longest match by simulating the
+ * automaton. For a search from the start of the string, it first
+ * checks for any match using the DFA, which quickly rejects strings
+ * that don't match. This method is an overridden search() method for
+ * the AutomatonPattern.
+ *
+ * @param pat the automaton pattern
+ * @param from first index where the match may begin
+ * @param begin returns the index of the first character in the match
+ * @param end returns the index one past the end of the match
+ * @return true if a match was found
+ */
+static bool searchAutomatonPattern( Pattern *pat, int from, int *begin,
+                                    int *end )
+{
+  AutomatonPattern *this = (AutomatonPattern *) pat;
+
+  if ( from == 0 && !nfaTest( this->nfa, this->str, this->len, from ) )
+    return false;
+  return nfaSearch( this->nfa, this->str, this->len, from, begin, end );
+}
+
+/**
+ * Method that checks for any match with the DFA, which stops as soon
+ * as it reaches an accepting state. It doesn't need to call locate()
+ * first. This method is an overridden test() method for the
+ * AutomatonPattern.
+ *
+ * @param pat the automaton pattern
+ * @param str the string to check
+ * @return true if the pattern matches anywhere in str
+ */
+static bool testAutomatonPattern( Pattern *pat, char const *str )
+{
+  AutomatonPattern *this = (AutomatonPattern *) pat;
+
+  this->str = str;
+  this->len = strlen( str );
+  return nfaTest( this->nfa, str, this->len, 0 );
+}
+
+/**
+ * Method that adds states for the pattern this automaton was compiled
+ * from. This method is an overridden compile() method for the
+ * AutomatonPattern.
+ *
+ * @param pat the automaton pattern
+ * @param nfa the automaton to add states to
+ * @param next the state to move to after a match
+ * @return the first state for this pattern
+ */
+static int compileAutomatonPattern( Pattern *pat, Nfa *nfa, int next )
+{
+  AutomatonPattern *this = (AutomatonPattern *) pat;
+
+  return this->pat->compile( this->pat, nfa, next );
+}
+
+/**
+ * Method that makes an automaton pattern with its methods and fields
+ * filled in, except for the automaton.
+ *
+ * @param pat the pattern the automaton is compiled from
+ * @return a dynamically allocated automaton pattern
+ */
+static AutomatonPattern *makeEmptyAutomaton( Pattern *pat );
+
+/**
+ * Method that makes a copy of the automaton pattern, with a copy of the
+ * original pattern and an automaton that shares the original's states.
+ * Only the automaton's scratch space is new, so the copy is cheap to
+ * make. This method is an overridden clone() method for the
+ * AutomatonPattern.
+ *
+ * @param pat the automaton pattern
+ * @return a dynamically allocated copy of the pattern
+ */
+static Pattern *cloneAutomatonPattern( Pattern *pat )
+{
+  AutomatonPattern *this = (AutomatonPattern *) pat;
+
+  Pattern *child = this->pat->clone( this->pat );
+  AutomatonPattern *copy = makeEmptyAutomaton( child );
+  copy->nfa = shareNfa( this->nfa );
+  return (Pattern *) copy;
+}
+
+/**
+ * Method that finds literal strings required by the pattern this
+ * automaton was compiled from. This method is an overridden analyze()
+ * method for the AutomatonPattern.
+ *
+ * @param pat the automaton pattern
+ * @param info returns literal strings for the pattern
+ */
+static void analyzeAutomatonPattern( Pattern *pat, LiteralInfo *info )
+{
+  AutomatonPattern *this = (AutomatonPattern *) pat;
+
+  this->pat->analyze( this->pat, info );
+}
+
+// Documented above.
+static AutomatonPattern *makeEmptyAutomaton( Pattern *pat )
+{
+  AutomatonPattern *this = (AutomatonPattern *) malloc( sizeof( AutomatonPattern ) );
+  clearTable( (Pattern *) this );
+  this->kind = AUTOMATON_PATTERN;
+  this->locate = locateAutomatonPattern;
+  this->search = searchAutomatonPattern;
+  this->test = testAutomatonPattern;
+  this->compile = compileAutomatonPattern;
+  this->visit = visitAutomatonPattern;
+  this->clone = cloneAutomatonPattern;
+  this->analyze = analyzeAutomatonPattern;
+  this->destroy = destroyAutomatonPattern;
+
+  this->pat = pat;
+  this->str = "";
+  return this;
+}
+
+// Documented in header.
+Pattern *makeAutomatonPattern( Pattern *pat )
+{
+  AutomatonPattern *this = makeEmptyAutomaton( pat );
+  this->nfa = makeNfa();
+  this->nfa->start = pat->compile( pat, this->nfa, this->nfa->match );
+  return (Pattern *) this;
+}
+
+/**
+ * Pattern that matches any of a list of patterns, by simulating one
+ * automaton compiled from all of them. Each pattern leads to its own
+ * match state, so one pass over a string can report which of the
+ * patterns matched it. A set can also be made from an automaton that
+ * was compiled earlier (e.g., loaded from a cache file), in which case
+ * it doesn't have the patterns themselves.
+ */
+typedef struct {
+  // Fields from our superclass.
+  PatternKind kind;
+  int len;
+  uint64_t *table;
+  int words;
+  size_t capacity;
+  PatternStats stats;
+  void (*locate)( Pattern *pat, char const *str );
+  bool (*search)( Pattern *pat, int from, int *begin, int *end );
+  bool (*test)( Pattern *pat, char const *str );
+  int (*compile)( Pattern *pat, Nfa *nfa, int next );
+  void (*visit)( Pattern *pat, void (*fn)( Pattern *pat, void *data ),
+                 void *data );
+  Pattern *(*clone)( Pattern *pat );
+  void (*analyze)( Pattern *pat, LiteralInfo *info );
+  void (*destroy)( Pattern *pat );
+
+  /** The patterns in the set, or NULL if we just have the automaton. */
+  Pattern **pats;
+  /** Number of patterns in the set. */
+  int count;
+  /** Literal string every match must contain, if we just have the
+      automaton and the literal is known.  Otherwise, NULL. */
+  char *literal;
+  /** The automaton compiled from all the patterns. */
+  Nfa *nfa;
+  /** The most recent input string. */
+  char const *str;
+  /** IDs of the patterns that matched the last string checked. */
+  int *ids;
+} SetPattern;
+
+/** The overridden destroy() function used for SetPattern. */
+static void destroySetPattern( Pattern *pat )
+{
+  SetPattern *this = (SetPattern *) pat;
+
+  for ( int i = 0; this->pats && i < this->count; i++ ) {
+    this->pats[ i ]->destroy( this->pats[ i ] );
+  }
+  free( this->pats );
+  free( this->literal );
+  free( this->ids );
+  freeNfa( this->nfa );
+  free( this );
+}
+
+/** The overridden visit() function used for SetPattern. */
+static void visitSetPattern( Pattern *pat,
+                             void (*fn)( Pattern *pat, void *data ),
+                             void *data )
+{
+  SetPattern *this = (SetPattern *) pat;
+
+  for ( int i = 0; this->pats && i < this->count; i++ ) {
+    this->pats[ i ]->visit( this->pats[ i ], fn, data );
+  }
+  fn( pat, data );
+}
+
+/** The overridden locate() function used for SetPattern. */
+static void locateSetPattern( Pattern *pat, char const *str )
+{
+  SetPattern *this = (SetPattern *) pat;
+
+  this->str = str;
+  this->len = strlen( str );
+}
+
+/**
+ * Method that finds the leftmost-longest match of any pattern in the
+ * set. This method is an overridden search() method for the SetPattern.
+ *
+ * @param pat the set pattern
+ * @param from first index where the match may begin
+ * @param begin returns the index of the first character in the match
+ * @param end returns the index one past the end of the match
+ * @return true if a match was found
+ */
+static bool searchSetPattern( Pattern *pat, int from, int *begin, int *end )
+{
+  SetPattern *this = (SetPattern *) pat;
+
+  if ( from == 0 && !nfaTest( this->nfa, this->str, this->len, from ) )
+    return false;
+  return nfaSearch( this->nfa, this->str, this->len, from, begin, end );
+}
+
+/** The overridden test() function used for SetPattern. */
+static bool testSetPattern( Pattern *pat, char const *str )
+{
+  SetPattern *this = (SetPattern *) pat;
+
+  locateSetPattern( pat, str );
+  return nfaTest( this->nfa, str, this->len, 0 );
+}
+
+/**
+ * Method that adds states for any one of the patterns in the set, like
+ * an alternation. Without the patterns, it copies the states of the
+ * set's own automaton instead. This method is an overridden compile()
+ * method for the SetPattern.
+ *
+ * @param pat the set pattern
+ * @param nfa the automaton to add states to
+ * @param next the state to move to after a match
+ * @return the first state for this pattern
+ */
+static int compileSetPattern( Pattern *pat, Nfa *nfa, int next )
+{
+  SetPattern *this = (SetPattern *) pat;
+
+  if ( !this->pats ) {
+    return appendNfa( nfa, this->nfa, next );
+  }
+
+  int first = this->pats[ this->count - 1 ]->compile(
+    this->pats[ this->count - 1 ], nfa, next );
+  for ( int i = this->count - 2; i >= 0; i-- ) {
+    int start = this->pats[ i ]->compile( this->pats[ i ], nfa, next );
+    first = addSplitState( nfa, start, first );
+  }
+  return first;
+}
+
+/**
+ * Method that makes a set pattern with its methods and fields filled
+ * in, except for the automaton and the patterns it was compiled from.
+ *
+ * @param count the number of patterns in the set
+ * @return a dynamically allocated set pattern
+ */
+static SetPattern *makeEmptySet( int count );
+
+/** The overridden clone() function used for SetPattern.  The copy
+    shares the original's automaton states, like an AutomatonPattern. */
+static Pattern *cloneSetPattern( Pattern *pat )
+{
+  SetPattern *this = (SetPattern *) pat;
+
+  SetPattern *copy = makeEmptySet( this->count );
+  copy->nfa = shareNfa( this->nfa );
+  if ( this->literal ) {
+    copy->literal = copyString( this->literal );
+  }
+  if ( this->pats ) {
+    copy->pats = (Pattern **) malloc( this->count * sizeof( Pattern * ) );
+    for ( int i = 0; i < this->count; i++ ) {
+      copy->pats[ i ] = this->pats[ i ]->clone( this->pats[ i ] );
+    }
+  }
+  return (Pattern *) copy;
+}
+
+/**
+ * Method that finds literal strings required by the set. A set of one
+ * pattern requires whatever that pattern does, but otherwise a string
+ * only needs to match one of the patterns, so there's no literal
+ * unless one was given along with a compiled automaton. This method is
+ * an overridden analyze() method for the SetPattern.
+ *
+ * @param pat the set pattern
+ * @param info returns literal strings for the pattern
+ */
+static void analyzeSetPattern( Pattern *pat, LiteralInfo *info )
+{
+  SetPattern *this = (SetPattern *) pat;
+
+  if ( this->pats && this->count == 1 ) {
+    this->pats[ 0 ]->analyze( this->pats[ 0 ], info );
+  } else {
+    noLiteral( info );
+    if ( this->literal ) {
+      free( info->required );
+      info->required = copyString( this->literal );
+    }
+  }
+}
+
+// Documented above.
+static SetPattern *makeEmptySet( int count )
+{
+  SetPattern *this = (SetPattern *) malloc( sizeof( SetPattern ) );
+  clearTable( (Pattern *) this );
+  this->kind = SET_PATTERN;
+  this->locate = locateSetPattern;
+  this->search = searchSetPattern;
+  this->test = testSetPattern;
+  this->compile = compileSetPattern;
+  this->visit = visitSetPattern;
+  this->clone = cloneSetPattern;
+  this->analyze = analyzeSetPattern;
+  this->destroy = destroySetPattern;
+
+  this->pats = NULL;
+  this->count = count;
+  this->literal = NULL;
+  this->ids = (int *) malloc( count * sizeof( int ) );
+  this->str = "";
+  return this;
+}
+
+// Documented in header.
+Pattern *makePatternSet( Pattern **pats, int count )
+{
+  SetPattern *this = makeEmptySet( count );
+  this->pats = (Pattern **) malloc( count * sizeof( Pattern * ) );
+
+  // Build the automaton back to front, so pattern i leads to the
+  // match state with ID i.
+  this->nfa = makeNfa();
+  int first = 0;
+  for ( int i = count - 1; i >= 0; i-- ) {
+    this->pats[ i ] = pats[ i ];
+    int match = i == 0 ? this->nfa->match : addMatchState( this->nfa, i );
+    int start = pats[ i ]->compile( pats[ i ], this->nfa, match );
+    first = i == count - 1 ? start : addSplitState( this->nfa, start, first );
+  }
+  this->nfa->start = first;
+  return (Pattern *) this;
+}
+
+// Documented in header.
+Pattern *makeCompiledPattern( Nfa *nfa, char const *literal )
+{
+  SetPattern *this = makeEmptySet( nfa->ids );
+  this->nfa = nfa;
+  if ( literal && literal[ 0 ] ) {
+    this->literal = copyString( literal );
+  }
+  return (Pattern *) this;
+}
+
+// Documented in header.
+Nfa const *patternSetAutomaton( Pattern *pat )
+{
+  SetPattern *this = (SetPattern *) pat;
+
+  return this->nfa;
+}
+
+/**
+ * Method that lets the pattern inside a caseless pattern find the match.
+ * This method is an overridden search() method for the CaselessPattern.
+ *
+ * @param pat the caseless pattern
+ * @param from first index where the match may begin
+ * @param begin returns the index of the first character in the match
+ * @param end returns the index one past the end of the match
+ * @return true if a match was found
+ */
+static bool searchCaselessPattern( Pattern *pat, int from, int *begin,
+                                   int *end );
+
+/**
+ * Function that returns the pattern inside a caseless pattern, or the
+ * pattern itself.  Automata inside a caseless pattern are folded, so
+ * they can work on input that hasn't been.
+ *
+ * @param pat the pattern
+ * @return the pattern that does the matching
+ */
+static Pattern *caseSensitive( Pattern *pat );
+
+/**
+ * Pattern that checks each input string for a literal string required
+ * by every match, and only lets the pattern it contains do its
+ * matching if the literal is there.
+ */
+typedef struct {
+  // Fields from our superclass.
+  PatternKind kind;
+  int len;
+  uint64_t *table;
+  int words;
+  size_t capacity;
+  PatternStats stats;
+  void (*locate)( Pattern *pat, char const *str );
+  bool (*search)( Pattern *pat, int from, int *begin, int *end );
+  bool (*test)( Pattern *pat, char const *str );
+  int (*compile)( Pattern *pat, Nfa *nfa, int next );
+  void (*visit)( Pattern *pat, void (*fn)( Pattern *pat, void *data ),
+                 void *data );
+  Pattern *(*clone)( Pattern *pat );
+  void (*analyze)( Pattern *pat, LiteralInfo *info );
+  void (*destroy)( Pattern *pat );
+
+  /** The pattern that does the matching. */
+  Pattern *pat;
+  /** Literal string every match must contain. */
+  char *literal;
+  /** True if the most recent input string didn't contain the literal. */
+  bool rejected;
+} PrefilterPattern;
+
+/** The overridden destroy() function used for PrefilterPattern. */
+static void destroyPrefilterPattern( Pattern *pat )
+{
+  PrefilterPattern *this = (PrefilterPattern *) pat;
+
+  this->pat->destroy( this->pat );
+  free( this->literal );
+  free( this );
+}
+
+/**
+ * Method that looks for the required literal in the input string. A
+ * single character is found with memchr(), and longer literals with
+ * strstr().
+ *
+ * @param this the prefilter pattern
+ * @param str the string to check
+ * @return true if the string doesn't contain the literal
+ */
+static bool rejectString( PrefilterPattern *this, char const *str )
+{
+  this->len = strlen( str );
+  this->stats.lines++;
+  if ( this->literal[ 1 ] == '\0' ) {
+    this->rejected = !memchr( str, this->literal[ 0 ], this->len );
+  } else {
+    this->rejected = !strstr( str, this->literal );
+  }
+
+  if ( this->rejected ) {
+    this->stats.rejected++;
+  }
+  return this->rejected;
+}
+
+/**
+ * Method that looks for the required literal in the input string, and
+ * only has the contained pattern find matches if it's there. This
+ * method is an overridden locate() method for the PrefilterPattern.
+ *
+ * @param pat the prefilter pattern
+ * @param str the string to find matches in
+ */
+static void locatePrefilterPattern( Pattern *pat, char const *str )
+{
+  PrefilterPattern *this = (PrefilterPattern *) pat;
+
+  if ( !rejectString( this, str ) ) {
+    this->pat->locate( this->pat, str );
+  }
+}
+
+/**
+ * Method that reports no match if the most recent string was rejected,
+ * and otherwise lets the contained pattern find the match. This method
+ * is an overridden search() method for the PrefilterPattern.
+ *
+ * @param pat the prefilter pattern
+ * @param from first index where the match may begin
+ * @param begin returns the index of the first character in the match
+ * @param end returns the index one past the end of the match
+ * @return true if a match was found
+ */
+static bool searchPrefilterPattern( Pattern *pat, int from, int *begin,
+                                    int *end )
+{
+  PrefilterPattern *this = (PrefilterPattern *) pat;
+
+  if ( this->rejected )
+    return false;
+  return this->pat->search( this->pat, from, begin, end );
+}
+
+/**
+ * Method that reports no match if the string doesn't contain the
+ * literal, and otherwise lets the contained pattern check it. This
+ * method is an overridden test() method for the PrefilterPattern.
+ *
+ * @param pat the prefilter pattern
+ * @param str the string to check
+ * @return true if the pattern matches anywhere in str
+ */
+static bool testPrefilterPattern( Pattern *pat, char const *str )
+{
+  PrefilterPattern *this = (PrefilterPattern *) pat;
+
+  if ( rejectString( this, str ) )
+    return false;
+  return this->pat->test( this->pat, str );
+}
+
+/** The overridden compile() function used for PrefilterPattern. */
+static int compilePrefilterPattern( Pattern *pat, Nfa *nfa, int next )
+{
+  PrefilterPattern *this = (PrefilterPattern *) pat;
+
+  return this->pat->compile( this->pat, nfa, next );
+}
+
+/** The overridden visit() function used for PrefilterPattern. */
+static void visitPrefilterPattern( Pattern *pat,
+                                   void (*fn)( Pattern *pat, void *data ),
+                                   void *data )
+{
+  PrefilterPattern *this = (PrefilterPattern *) pat;
+
+  this->pat->visit( this->pat, fn, data );
+  fn( pat, data );
+}
+
+/** The overridden clone() function used for PrefilterPattern. */
+static Pattern *clonePrefilterPattern( Pattern *pat )
+{
+  PrefilterPattern *this = (PrefilterPattern *) pat;
+
+  return makePrefilterPattern( this->pat->clone( this->pat ) );
+}
+
+/** The overridden analyze() function used for PrefilterPattern. */
+static void analyzePrefilterPattern( Pattern *pat, LiteralInfo *info )
+{
+  PrefilterPattern *this = (PrefilterPattern *) pat;
+
+  this->pat->analyze( this->pat, info );
+}
+
+// Documented in header.
+Pattern *makePrefilterPattern( Pattern *pat )
+{
+  LiteralInfo info;
+  pat->analyze( pat, &info );
+  if ( info.required[ 0 ] == '\0' ) {
+    freeLiteralInfo( &info );
+    return pat;
+  }
+
+  PrefilterPattern *this = (PrefilterPattern *) malloc( sizeof( PrefilterPattern ) );
+  clearTable( (Pattern *) this );
+  this->kind = PREFILTER_PATTERN;
+  this->locate = locatePrefilterPattern;
+  this->search = searchPrefilterPattern;
+  this->test = testPrefilterPattern;
+  this->compile = compilePrefilterPattern;
+  this->visit = visitPrefilterPattern;
+  this->clone = clonePrefilterPattern;
+  this->analyze = analyzePrefilterPattern;
+  this->destroy = destroyPrefilterPattern;
+
+  this->pat = pat;
+  this->literal = copyString( info.required );
+  this->rejected = false;
+  freeLiteralInfo( &info );
+  return (Pattern *) this;
+}
+
+// Documented in header.
+char *requiredLiteral( Pattern *pat )
+{
+  LiteralInfo info;
+  pat->analyze( pat, &info );
+  char *literal = copyString( info.required );
+  freeLiteralInfo( &info );
+  return literal;
+}
+
+// Documented in header.
+bool matchCaptures( Pattern *pat, int begin, int end, int *caps, int slots )
+{
+  pat = caseSensitive( pat );
+  if ( pat->kind == PREFILTER_PATTERN )
+    pat = ( (PrefilterPattern *) pat )->pat;
+  AutomatonPattern *this = (AutomatonPattern *) pat;
+
+  return nfaCaptures( this->nfa, this->str, this->len, begin, end, caps,
+                      slots );
+}
+
+// Documented in header.
+Nfa *patternAutomaton( Pattern *pat )
+{
+  pat = caseSensitive( pat );
+  if ( pat->kind == PREFILTER_PATTERN )
+    pat = ( (PrefilterPattern *) pat )->pat;
+  if ( pat->kind == SET_PATTERN )
+    return ( (SetPattern *) pat )->nfa;
+  if ( pat->kind == AUTOMATON_PATTERN )
+    return ( (AutomatonPattern *) pat )->nfa;
+  return NULL;
+}
+
+// Documented in header.
+int matchedPatterns( Pattern *pat, char const *str, int const **ids )
+{
+  pat = caseSensitive( pat );
+  if ( pat->kind == PREFILTER_PATTERN )
+    pat = ( (PrefilterPattern *) pat )->pat;
+  assert( pat->kind == SET_PATTERN );
+  SetPattern *this = (SetPattern *) pat;
+
+  locateSetPattern( pat, str );
+  *ids = this->ids;
+  return nfaMatches( this->nfa, str, this->len, this->ids );
+}
+
+/**
+ * Pattern that folds each input string to lowercase and has the pattern
+ * it contains match the folded string.  With a pattern parsed with
+ * PARSE_IGNORE_CASE, that matches letters in either case, but the tree
+ * is just as small as for a case-sensitive pattern, and any literals
+ * are still found by the prefilter.
+ */
+typedef struct {
+  // Fields from our superclass.
+  PatternKind kind;
+  int len;
+  uint64_t *table;
+  int words;
+  size_t capacity;
+  PatternStats stats;
+  void (*locate)( Pattern *pat, char const *str );
+  bool (*search)( Pattern *pat, int from, int *begin, int *end );
+  bool (*test)( Pattern *pat, char const *str );
+  int (*compile)( Pattern *pat, Nfa *nfa, int next );
+  void (*visit)( Pattern *pat, void (*fn)( Pattern *pat, void *data ),
+                 void *data );
+  Pattern *(*clone)( Pattern *pat );
+  void (*analyze)( Pattern *pat, LiteralInfo *info );
+  void (*destroy)( Pattern *pat );
+
+  /** The pattern that matches the folded input. */
+  Pattern *pat;
+
+  /** True if the pattern needs folded input, false if it's just an
+      automaton, which has been folded itself. */
+  bool fold;
+
+  /** Folded copy of the most recent input string. */
+  char *folded;
+
+  /** Number of characters there's room for in folded. */
+  int room;
+} CaselessPattern;
+
+/** The overridden destroy() function used for CaselessPattern. */
+static void destroyCaselessPattern( Pattern *pat )
+{
+  CaselessPattern *this = (CaselessPattern *) pat;
+
+  this->pat->destroy( this->pat );
+  free( this->folded );
+  free( this );
+}
+
+/**
+ * Method that makes a lowercase copy of an input string, if the
+ * contained pattern needs one.
+ *
+ * @param this the caseless pattern
+ * @param str the string to fold
+ * @return the folded copy, which belongs to the pattern, or str
+ */
+static char const *foldInput( CaselessPattern *this, char const *str )
+{
+  this->len = strlen( str );
+  if ( !this->fold )
+    return str;
+  if ( this->len + 1 > this->room ) {
+    this->room = 2 * ( this->len + 1 );
+    this->folded = (char *) realloc( this->folded, this->room );
+  }
+  foldString( str, this->len + 1, this->folded );
+  return this->folded;
+}
+
+/**
+ * Method that has the contained pattern find matches in a lowercase
+ * copy of the input string. Folding doesn't move any characters, so
+ * the matches are at the same places in the original. This method is
+ * an overridden locate() method for the CaselessPattern.
+ *
+ * @param pat the caseless pattern
+ * @param str the string to find matches in
+ */
+static void locateCaselessPattern( Pattern *pat, char const *str )
+{
+  CaselessPattern *this = (CaselessPattern *) pat;
+
+  this->pat->locate( this->pat, foldInput( this, str ) );
+}
+
+// Documented above.
+static bool searchCaselessPattern( Pattern *pat, int from, int *begin,
+                                   int *end )
+{
+  CaselessPattern *this = (CaselessPattern *) pat;
+
+  return this->pat->search( this->pat, from, begin, end );
+}
+
+/** The overridden test() function used for CaselessPattern. */
+static bool testCaselessPattern( Pattern *pat, char const *str )
+{
+  CaselessPattern *this = (CaselessPattern *) pat;
+
+  return this->pat->test( this->pat, foldInput( this, str ) );
+}
+
+/**
+ * Method that adds states for the contained pattern to an automaton,
+ * then folds them, since the automaton sees input that hasn't been
+ * folded. This method is an overridden compile() method for the
+ * CaselessPattern.
+ *
+ * @param pat the caseless pattern
+ * @param nfa the automaton to add states to
+ * @param next the state to move to after a match
+ * @return the first state for this pattern
+ */
+static int compileCaselessPattern( Pattern *pat, Nfa *nfa, int next )
+{
+  CaselessPattern *this = (CaselessPattern *) pat;
+
+  int first = nfa->count;
+  int start = this->pat->compile( this->pat, nfa, next );
+  foldNfa( nfa, first );
+  return start;
+}
+
+/** The overridden visit() function used for CaselessPattern. */
+static void visitCaselessPattern( Pattern *pat,
+                                  void (*fn)( Pattern *pat, void *data ),
+                                  void *data )
+{
+  CaselessPattern *this = (CaselessPattern *) pat;
+
+  this->pat->visit( this->pat, fn, data );
+  fn( pat, data );
+}
+
+/**
+ * Method that makes a caseless pattern around the given pattern,
+ * without folding any automaton it uses.
+ *
+ * @param pat the pattern to match folded strings
+ * @return a dynamically allocated caseless pattern
+ */
+static CaselessPattern *makeEmptyCaseless( Pattern *pat );
+
+/** The overridden clone() function used for CaselessPattern.  Any
+    automaton in the copy shares states that are already folded, and
+    other threads may be using them, so they're left alone. */
+static Pattern *cloneCaselessPattern( Pattern *pat )
+{
+  CaselessPattern *this = (CaselessPattern *) pat;
+
+  return (Pattern *) makeEmptyCaseless( this->pat->clone( this->pat ) );
+}
+
+/**
+ * Method that reports no literal strings, since the contained pattern's
+ * literals are only in folded input. A prefilter belongs inside the
+ * caseless pattern instead. This method is an overridden analyze()
+ * method for the CaselessPattern.
+ *
+ * @param pat the caseless pattern
+ * @param info returns literal strings for the pattern
+ */
+static void analyzeCaselessPattern( Pattern *pat, LiteralInfo *info )
+{
+  noLiteral( info );
+}
+
+// Documented above.
+static CaselessPattern *makeEmptyCaseless( Pattern *pat )
+{
+  CaselessPattern *this = (CaselessPattern *) malloc( sizeof( CaselessPattern ) );
+  clearTable( (Pattern *) this );
+  this->kind = CASELESS_PATTERN;
+  this->locate = locateCaselessPattern;
+  this->search = searchCaselessPattern;
+  this->test = testCaselessPattern;
+  this->compile = compileCaselessPattern;
+  this->visit = visitCaselessPattern;
+  this->clone = cloneCaselessPattern;
+  this->analyze = analyzeCaselessPattern;
+  this->destroy = destroyCaselessPattern;
+
+  // If nothing but an automaton needs the input folded, we don't fold it.
+  this->fold = pat->kind != AUTOMATON_PATTERN
+    && pat->kind != SET_PATTERN;
+
+  this->pat = pat;
+  this->folded = NULL;
+  this->room = 0;
+  return this;
+}
+
+// Documented in header.
+Pattern *makeCaselessPattern( Pattern *pat )
+{
+  // An automaton already built for pat can work on the original input.
+  Nfa *nfa = patternAutomaton( pat );
+  if ( nfa ) {
+    foldNfa( nfa, 0 );
+  }
+  return (Pattern *) makeEmptyCaseless( pat );
+}
+
+// Documented above.
+static Pattern *caseSensitive( Pattern *pat )
+{
+  if ( pat->kind == CASELESS_PATTERN )
+    return ( (CaselessPattern *) pat )->pat;
+  return pat;
+}
+
+/**
+ * Growable list of patterns, used by the optimizer while it takes apart
+ * chains of concatenations or alternations and builds new ones.
+ */
+typedef struct {
+  /** The patterns in the list. */
+  Pattern **list;
+  /** Number of patterns in the list. */
+  int count;
+  /** Number of patterns there's room for. */
+  int capacity;
+} PatternList;
+
+/**
+ * Method that initializes an empty pattern list.
+ *
+ * @param pl the list to initialize
+ */
+static void initPatternList( PatternList *pl )
+{
+  pl->count = 0;
+  pl->capacity = 4;
+  pl->list = (Pattern **) malloc( pl->capacity * sizeof( Pattern * ) );
+}
+
+/**
+ * Method that adds a pattern to the end of a pattern list.
+ *
+ * @param pl the list to add to
+ * @param pat the pattern to add
+ */
+static void addToList( PatternList *pl, Pattern *pat )
+{
+  if ( pl->count >= pl->capacity ) {
+    pl->capacity *= 2;
+    pl->list = (Pattern **) realloc( pl->list,
+                                     pl->capacity * sizeof( Pattern * ) );
+  }
+  pl->list[ pl->count++ ] = pat;
+}
+
+/**
+ * Method that frees the struct for a concatenation or alternation
+ * pattern, but not the sub patterns, after the optimizer has taken
+ * them out.
+ *
+ * @param pat the pattern to free
+ */
+static void releaseBinaryPattern( Pattern *pat )
+{
+  freeTable( pat );
+  free( pat );
+}
+
+/**
+ * Method that reports the literal string a pattern starts with, if it
+ * starts with a symbol or literal pattern.
+ *
+ * @param pat the pattern to check
+ * @param n returns the length of the literal
+ * @return pointer to the literal, or NULL if the pattern doesn't start
+ * with one
+ */
+static char const *leadingLiteral( Pattern *pat, int *n )
+{
+  while ( pat->kind == CONCATENATION_PATTERN )
+    pat = ( (BinaryPattern *) pat )->p1;
+
+  if ( pat->kind == SYMBOL_PATTERN ) {
+    *n = 1;
+    return &( (SymbolPattern *) pat )->sym;
+  }
+  if ( pat->kind == LITERAL_PATTERN ) {
+    *n = ( (LiteralPattern *) pat )->length;
+    return ( (LiteralPattern *) pat )->str;
+  }
+  return NULL;
+}
+
+/**
+ * Method that adds the characters matched by a single-character
+ * pattern (a symbol, a character class or '.') to a set.
+ *
+ * @param pat the pattern to check
+ * @param set the set to add characters to
+ * @return true if pat is a single-character pattern
+ */
+static bool addSingleChars( Pattern *pat, CharSet *set )
+{
+  if ( pat->kind == SYMBOL_PATTERN ) {
+    csetAdd( set, ( (SymbolPattern *) pat )->sym );
+  } else if ( pat->kind == CHAR_CLASS_PATTERN ) {
+    for ( int i = 0; i < CSET_WORDS; i++ )
+      set->bits[ i ] |= ( (CharClassPattern *) pat )->members.bits[ i ];
+  } else if ( pat->kind == METACHAR_PATTERN
+              && ( (MetacharPattern *) pat )->metachar == '.' ) {
+    for ( int c = 1; c < CSET_WORDS * CSET_WORD_BITS; c++ )
+      csetAdd( set, c );
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Method that takes apart a chain of concatenations, adding the
+ * patterns in it to a list in order.
+ *
+ * @param pat the pattern to take apart
+ * @param items the list to add to
+ */
+static void flattenConcatenation( Pattern *pat, PatternList *items )
+{
+  // Walk down the left side without recursion, saving the right sides
+  // to take apart afterward.  Trees are built balanced, so that
+  // recursion only goes about log2( n ) levels deep.
+  PatternList right;
+  initPatternList( &right );
+  while ( pat->kind == CONCATENATION_PATTERN ) {
+    BinaryPattern *this = (BinaryPattern *) pat;
+    addToList( &right, this->p2 );
+    pat = this->p1;
+    releaseBinaryPattern( (Pattern *) this );
+  }
+  addToList( items, pat );
+  for ( int i = right.count - 1; i >= 0; i-- )
+    flattenConcatenation( right.list[ i ], items );
+  free( right.list );
+}
+
+/**
+ * Method that takes apart a chain of alternations, adding the
+ * alternatives in it to a list in order.
+ *
+ * @param pat the pattern to take apart
+ * @param alts the list to add to
+ */
+static void flattenAlternation( Pattern *pat, PatternList *alts )
+{
+  // Walk down the left side without recursion, saving the right sides
+  // to take apart afterward.  Trees are built balanced, so that
+  // recursion only goes about log2( n ) levels deep.
+  PatternList right;
+  initPatternList( &right );
+  while ( pat->kind == ALTERNATION_PATTERN ) {
+    AlternationPattern *this = (AlternationPattern *) pat;
+    addToList( &right, this->p2 );
+    pat = this->p1;
+    releaseBinaryPattern( (Pattern *) this );
+  }
+  addToList( alts, pat );
+  for ( int i = right.count - 1; i >= 0; i-- )
+    flattenAlternation( right.list[ i ], alts );
+  free( right.list );
+}
+
+/**
+ * Method that builds a balanced tree of concatenations for the patterns
+ * in a list, and frees the list.
+ *
+ * @param items the patterns to concatenate
+ * @return the new pattern, or NULL if the list is empty
+ */
+static Pattern *buildConcatenation( PatternList *items )
+{
+  Pattern *pat = items->count ? makeConcatenationList( items->list,
+                                                       items->count ) : NULL;
+  free( items->list );
+  return pat;
+}
+
+/**
+ * Method that builds a balanced tree of alternations for the patterns
+ * in a list, and frees the list.
+ *
+ * @param alts the alternatives
+ * @return the new pattern, or NULL if the list is empty
+ */
+static Pattern *buildAlternation( PatternList *alts )
+{
+  Pattern *pat = alts->count ? makeAlternationList( alts->list,
+                                                    alts->count ) : NULL;
+  free( alts->list );
+  return pat;
+}
+
+/**
+ * Method that removes the first n characters from a pattern that starts
+ * with a literal string at least that long.
+ *
+ * @param pat the pattern to shorten, which is freed
+ * @param n the number of characters to remove
+ * @return the rest of the pattern, or NULL if nothing is left
+ */
+static Pattern *removePrefix( Pattern *pat, int n )
+{
+  PatternList items;
+  initPatternList( &items );
+  flattenConcatenation( pat, &items );
+
+  int len;
+  char const *lit = leadingLiteral( items.list[ 0 ], &len );
+  Pattern *rest = len > n ? makeStringPattern( lit + n, len - n ) : NULL;
+  items.list[ 0 ]->destroy( items.list[ 0 ] );
+  if ( rest ) {
+    items.list[ 0 ] = rest;
+  } else {
+    items.count--;
+    memmove( items.list, items.list + 1, items.count * sizeof( Pattern * ) );
+  }
+  return buildConcatenation( &items );
+}
+
+/**
+ * Method that concatenates adjacent symbols and literals in a list of
+ * patterns into single literal patterns. The list shouldn't contain any
+ * concatenations.
+ *
+ * @param items the list of patterns to fold, updated in place
+ */
+static void foldLiterals( PatternList *items )
+{
+  int count = 0;
+  for ( int i = 0; i < items->count; i++ ) {
+    // Find the whole run of literals starting here.
+    int len, total = 0;
+    int j = i;
+    while ( j < items->count && leadingLiteral( items->list[ j ], &len ) ) {
+      total += len;
+      j++;
+    }
+    if ( j - i < 2 ) {
+      items->list[ count++ ] = items->list[ i ];
+      continue;
+    }
+
+    char buffer[ total ];
+    int pos = 0;
+    for ( int k = i; k < j; k++ ) {
+      char const *lit = leadingLiteral( items->list[ k ], &len );
+      memcpy( buffer + pos, lit, len );
+      pos += len;
+      items->list[ k ]->destroy( items->list[ k ] );
+    }
+    items->list[ count++ ] = makeStringPattern( buffer, total );
+    i = j - 1;
+  }
+  items->count = count;
+}
+
+/**
+ * Method that hoists literal prefixes out of alternatives, so the
+ * strings they share are only matched once. Alternatives that start
+ * with the same character are replaced by their longest common prefix
+ * followed by an alternation of what's left, which is optimized in
+ * turn. For a list of keywords, this builds a trie.
+ *
+ * @param alts the list of alternatives, updated in place
+ */
+static void factorPrefixes( PatternList *alts )
+{
+  PatternList result;
+  initPatternList( &result );
+  for ( int i = 0; i < alts->count; i++ ) {
+    if ( !alts->list[ i ] )
+      continue;
+
+    int len;
+    char const *lit = leadingLiteral( alts->list[ i ], &len );
+    int members = 1;
+    int common = len;
+    for ( int j = i + 1; lit && j < alts->count; j++ ) {
+      int jlen;
+      char const *jlit = alts->list[ j ] ? leadingLiteral( alts->list[ j ],
+                                                           &jlen ) : NULL;
+      if ( jlit && jlit[ 0 ] == lit[ 0 ] ) {
+        int n = 0;
+        while ( n < common && n < jlen && jlit[ n ] == lit[ n ] )
+          n++;
+        common = n;
+        members++;
+      }
+    }
+    if ( members == 1 ) {
+      addToList( &result, alts->list[ i ] );
+      continue;
+    }
+
+    // Take the prefix off every alternative that starts with it.
+    char prefix[ common ];
+    memcpy( prefix, lit, common );
+    PatternList rests;
+    initPatternList( &rests );
+    bool optional = false;
+    for ( int j = i; j < alts->count; j++ ) {
+      int jlen;
+      char const *jlit = alts->list[ j ] ? leadingLiteral( alts->list[ j ],
+                                                           &jlen ) : NULL;
+      if ( jlit && jlit[ 0 ] == prefix[ 0 ] ) {
+        Pattern *rest = removePrefix( alts->list[ j ], common );
+        alts->list[ j ] = NULL;
+        if ( rest ) {
+          addToList( &rests, rest );
+        } else {
+          optional = true;
+        }
+      }
+    }
+
+    Pattern *tail = buildAlternation( &rests );
+    Pattern *pat = makeStringPattern( prefix, common );
+    if ( tail ) {
+      tail = optimizePattern( tail );
+      if ( optional ) {
+        tail = makeRepetitionPattern( tail, 0, 1 );
+      }
+      pat = makeConcatenationPattern( pat, tail );
+    }
+    addToList( &result, pat );
+  }
+
+  free( alts->list );
+  *alts = result;
+}
+
+/**
+ * Method that replaces all the single-character alternatives in a list
+ * with one character class, placed where the first of them was.
+ *
+ * @param alts the list of alternatives, updated in place
+ */
+static void mergeCharAlternatives( PatternList *alts )
+{
+  CharSet set;
+  csetClear( &set );
+  int singles = 0;
+  for ( int i = 0; i < alts->count; i++ ) {
+    if ( addSingleChars( alts->list[ i ], &set ) )
+      singles++;
+  }
+  if ( singles < 2 )
+    return;
+
+  int count = 0;
+  bool placed = false;
+  for ( int i = 0; i < alts->count; i++ ) {
+    CharSet unused;
+    csetClear( &unused );
+    if ( addSingleChars( alts->list[ i ], &unused ) ) {
+      alts->list[ i ]->destroy( alts->list[ i ] );
+      if ( !placed ) {
+        alts->list[ count++ ] = makeCharSetPattern( &set );
+        placed = true;
+      }
+    } else {
+      alts->list[ count++ ] = alts->list[ i ];
+    }
+  }
+  alts->count = count;
+}
+
+/**
+ * Method that reports whether a repetition range is one of the ones
+ * for '*', '+' or '?' (or exactly one occurrence). Nested repetitions
+ * with these ranges can always be collapsed into one.
+ *
+ * @param min the minimum number of occurrences
+ * @param max the maximum number of occurrences, or -1 for no maximum
+ * @return true if the range is {0,1}, {1,1}, {0,} or {1,}
+ */
+static bool simpleRange( int min, int max )
+{
+  return ( min == 0 || min == 1 ) && ( max == 1 || max == -1 );
+}
+
+/**
+ * Method that optimizes a concatenation, by taking apart the whole
+ * chain, optimizing each part and folding runs of symbols into literals.
+ *
+ * @param pat the concatenation pattern, which is freed
+ * @return the optimized pattern
+ */
+static Pattern *optimizeConcatenation( Pattern *pat )
+{
+  PatternList parts, items;
+  initPatternList( &parts );
+  initPatternList( &items );
+  flattenConcatenation( pat, &parts );
+
+  // An optimized part can turn into a concatenation itself.
+  for ( int i = 0; i < parts.count; i++ )
+    flattenConcatenation( optimizePattern( parts.list[ i ] ), &items );
+  free( parts.list );
+
+  foldLiterals( &items );
+  return buildConcatenation( &items );
+}
+
+/**
+ * Method that optimizes an alternation, by taking apart the whole
+ * chain, optimizing each alternative, hoisting out common prefixes and
+ * merging single characters into a character class. The order of the
+ * alternatives can change, but that doesn't change which substrings
+ * the pattern matches.
+ *
+ * @param pat the alternation pattern, which is freed
+ * @return the optimized pattern
+ */
+static Pattern *optimizeAlternation( Pattern *pat )
+{
+  PatternList parts, alts;
+  initPatternList( &parts );
+  initPatternList( &alts );
+  flattenAlternation( pat, &parts );
+
+  for ( int i = 0; i < parts.count; i++ )
+    flattenAlternation( optimizePattern( parts.list[ i ] ), &alts );
+  free( parts.list );
+
+  factorPrefixes( &alts );
+  mergeCharAlternatives( &alts );
+  return buildAlternation( &alts );
+}
+
+/**
+ * Method that optimizes a repetition, by collapsing a repetition of a
+ * repetition (like (a*)+) into one, and removing a repetition of
+ * exactly one occurrence.
+ *
+ * @param pat the repetition pattern, which is freed
+ * @return the optimized pattern
+ */
+static Pattern *optimizeRepetition( Pattern *pat )
+{
+  RepetitionPattern *this = (RepetitionPattern *) pat;
+  this->pat = optimizePattern( this->pat );
+
+  Pattern *sub = this->pat;
+  if ( sub->kind == REPETITION_PATTERN
+       && simpleRange( this->min, this->max ) ) {
+    RepetitionPattern *inner = (RepetitionPattern *) sub;
+    if ( simpleRange( inner->min, inner->max ) ) {
+      this->min *= inner->min;
+      if ( inner->max == -1 )
+        this->max = -1;
+      this->pat = inner->pat;
+      freeTable( sub );
+      free( inner->work );
+      free( inner );
+    }
+  }
+
+  if ( this->min == 1 && this->max == 1 ) {
+    sub = this->pat;
+    freeTable( pat );
+    free( this->work );
+    free( this );
+    return sub;
+  }
+  return pat;
+}
+
+// Documented in header.
+Pattern *optimizePattern( Pattern *pat )
+{
+  if ( pat->kind == CONCATENATION_PATTERN )
+    return optimizeConcatenation( pat );
+  if ( pat->kind == ALTERNATION_PATTERN )
+    return optimizeAlternation( pat );
+  if ( pat->kind == REPETITION_PATTERN )
+    return optimizeRepetition( pat );
+
+  // A class with just one member is the same as a symbol.
+  if ( pat->kind == CHAR_CLASS_PATTERN ) {
+    CharClassPattern *this = (CharClassPattern *) pat;
+    if ( csetCount( &this->members ) == 1 ) {
+      int c = 1;
+      while ( !CSET_HAS( &this->members, c ) )
+        c++;
+      pat->destroy( pat );
+      return makeSymbolPattern( (char) c );
+    }
+  }
+  return pat;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Profiling
+
+/** Profiler information about one type of pattern. */
+typedef struct {
+  /** Name printed for patterns of this type. */
+  char const *name;
+
+  /** The locate() function that replaces the type's own while profiling. */
+  void (*profiled)( Pattern *pat, char const *str );
+} PatternType;
+
+/**
+ * Function that reads a counter that goes up steadily with time, the
+ * processor's cycle counter where there is one.
+ *
+ * @return the current count
+ */
+static long readCycles()
+{
+#if defined( __x86_64__ )
+  return (long) __rdtsc();
+#else
+  return (long) clock();
+#endif
+}
+
+/**
+ * Function that runs a pattern's own locate() function and adds the
+ * call to the pattern's profiling counters.
+ *
+ * @param pat the pattern being matched
+ * @param str the string to find matches in
+ * @param locate the locate() function for the pattern's type
+ */
+static void profileLocate( Pattern *pat, char const *str,
+                           void (*locate)( Pattern *pat, char const *str ) )
+{
+  long start = readCycles();
+  locate( pat, str );
+  pat->stats.cycles += readCycles() - start;
+  pat->stats.calls++;
+
+  // Patterns that work without a table don't set any cells.
+  if ( pat->table ) {
+    uint64_t const *table = tableRow( pat, 0 );
+    for ( int w = 0; w < ( pat->len + 1 ) * pat->words; w++ )
+      pat->stats.cells += __builtin_popcountll( table[ w ] );
+  }
+}
+
+/** Define the profiled locate() function for the given type of
+    pattern, a function that counts the work done by the type's own
+    locate(). */
+#define PROFILED( type )                                              \
+  static void profile##type##Pattern( Pattern *pat, char const *str ) \
+  {                                                                   \
+    profileLocate( pat, str, locate##type##Pattern );                 \
+  }
+
+PROFILED( Symbol )
+PROFILED( Literal )
+PROFILED( Concatenation )
+PROFILED( Metachar )
+PROFILED( CharClass )
+PROFILED( Alternation )
+PROFILED( Repetition )
+PROFILED( Capture )
+PROFILED( Automaton )
+PROFILED( Set )
+PROFILED( Prefilter )
+PROFILED( Caseless )
+
+/** Every type of pattern, indexed by its kind, with its profiled
+    locate() function. */
+static PatternType const patternTypes[ PATTERN_KINDS ] = {
+  [ SYMBOL_PATTERN ] = { "Symbol", profileSymbolPattern },
+  [ LITERAL_PATTERN ] = { "Literal", profileLiteralPattern },
+  [ CONCATENATION_PATTERN ] =
+    { "Concatenation", profileConcatenationPattern },
+  [ METACHAR_PATTERN ] = { "Metachar", profileMetacharPattern },
+  [ CHAR_CLASS_PATTERN ] = { "CharClass", profileCharClassPattern },
+  [ ALTERNATION_PATTERN ] = { "Alternation", profileAlternationPattern },
+  [ REPETITION_PATTERN ] = { "Repetition", profileRepetitionPattern },
+  [ CAPTURE_PATTERN ] = { "Capture", profileCapturePattern },
+  [ AUTOMATON_PATTERN ] = { "Automaton", profileAutomatonPattern },
+  [ SET_PATTERN ] = { "Set", profileSetPattern },
+  [ PREFILTER_PATTERN ] = { "Prefilter", profilePrefilterPattern },
+  [ CASELESS_PATTERN ] = { "Caseless", profileCaselessPattern }
+};
+
+/**
+ * Function that finds the type of a pattern, whether or not it's being
+ * profiled.
+ *
+ * @param pat the pattern
+ * @return index of the pattern's type in patternTypes
+ */
+static int patternType( Pattern *pat )
+{
+  assert( pat->kind >= 0 && pat->kind < PATTERN_KINDS
+          && patternTypes[ pat->kind ].name );
+  return pat->kind;
+}
+
+/**
+ * Function used with visit() to switch a pattern over to its profiled
+ * locate() function.
+ *
+ * @param pat the pattern to profile
+ * @param data not used
+ */
+static void startProfiling( Pattern *pat, void *data )
+{
+  pat->locate = patternTypes[ patternType( pat ) ].profiled;
+}
+
+// Documented in header.
+void profilePattern( Pattern *pat )
+{
+  pat->visit( pat, startProfiling, NULL );
+}
+
+/**
+ * Function that reports the subpatterns a pattern contains.
+ *
+ * @param pat the pattern
+ * @param subs returns a pointer to a list of the subpatterns
+ * @param room storage the list can use, with room for two patterns
+ * @return the number of subpatterns
+ */
+static int subpatterns( Pattern *pat, Pattern ***subs, Pattern **room )
+{
+  *subs = room;
+  switch ( patternType( pat ) ) {
+  case CONCATENATION_PATTERN:
+  case ALTERNATION_PATTERN:
+    room[ 0 ] = ( (BinaryPattern *) pat )->p1;
+    room[ 1 ] = ( (BinaryPattern *) pat )->p2;
+    return 2;
+  case REPETITION_PATTERN:
+    room[ 0 ] = ( (RepetitionPattern *) pat )->pat;
+    return 1;
+  case CAPTURE_PATTERN:
+    room[ 0 ] = ( (CapturePattern *) pat )->pat;
+    return 1;
+  case AUTOMATON_PATTERN:
+    room[ 0 ] = ( (AutomatonPattern *) pat )->pat;
+    return 1;
+  case PREFILTER_PATTERN:
+    room[ 0 ] = ( (PrefilterPattern *) pat )->pat;
+    return 1;
+  case CASELESS_PATTERN:
+    room[ 0 ] = ( (CaselessPattern *) pat )->pat;
+    return 1;
+  case SET_PATTERN: {
+    SetPattern *this = (SetPattern *) pat;
+    *subs = this->pats;
+    return this->pats ? this->count : 0;
+  }
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Function that prints one line of the profile for a pattern and then
+ * the lines for its subpatterns, indented under it.  The cycles a
+ * pattern spent outside its subpatterns are added to the totals for
+ * its type.  Subpatterns can also be matched by a test() function
+ * without going through the pattern's locate(), so this can't be
+ * less than zero.
+ *
+ * @param pat the pattern to print
+ * @param depth number of patterns this one is inside
+ * @param totals counters for each type of pattern, with cycles just
+ * for the patterns themselves
+ * @param nodes number of patterns of each type
+ * @param fp the stream to print to
+ */
+static void printProfileNode( Pattern *pat, int depth, PatternStats *totals,
+                              int *nodes, FILE *fp )
+{
+  Pattern *room[ 2 ];
+  Pattern **subs;
+  int count = subpatterns( pat, &subs, room );
+  long self = pat->stats.cycles;
+  for ( int i = 0; i < count; i++ )
+    self -= subs[ i ]->stats.cycles;
+  if ( self < 0 )
+    self = 0;
+
+  int t = patternType( pat );
+  fprintf( fp, "%10ld %14ld %14ld %12ld  %*s%s", pat->stats.calls,
+           pat->stats.cycles, self, pat->stats.cells, 2 * depth, "",
+           patternTypes[ t ].name );
+
+  if ( t == SYMBOL_PATTERN )
+    fprintf( fp, " '%c'", ( (SymbolPattern *) pat )->sym );
+  else if ( t == LITERAL_PATTERN )
+    fprintf( fp, " \"%s\"", ( (LiteralPattern *) pat )->str );
+  else if ( t == METACHAR_PATTERN )
+    fprintf( fp, " %c", ( (MetacharPattern *) pat )->metachar );
+  else if ( t == CHAR_CLASS_PATTERN
+            && ( (CharClassPattern *) pat )->cclass[ 0 ] )
+    fprintf( fp, " [%s]", ( (CharClassPattern *) pat )->cclass );
+  else if ( t == REPETITION_PATTERN ) {
+    RepetitionPattern *this = (RepetitionPattern *) pat;
+    if ( this->max < 0 )
+      fprintf( fp, " {%d,}", this->min );
+    else
+      fprintf( fp, " {%d,%d}", this->min, this->max );
+  } else if ( t == CAPTURE_PATTERN )
+    fprintf( fp, " %d", ( (CapturePattern *) pat )->group );
+  fprintf( fp, "\n" );
+
+  totals[ t ].calls += pat->stats.calls;
+  totals[ t ].cycles += self;
+  totals[ t ].cells += pat->stats.cells;
+  nodes[ t ]++;
+
+  for ( int i = 0; i < count; i++ )
+    printProfileNode( subs[ i ], depth + 1, totals, nodes, fp );
+}
+
+// Documented in header.
+void printProfile( Pattern *pat, FILE *fp )
+{
+  PatternStats totals[ PATTERN_KINDS ];
+  int nodes[ PATTERN_KINDS ];
+  memset( totals, 0, sizeof( totals ) );
+  memset( nodes, 0, sizeof( nodes ) );
+
+  fprintf( fp, "%10s %14s %14s %12s  %s\n", "calls", "cycles", "self",
+           "cells", "pattern" );
+  printProfileNode( pat, 0, totals, nodes, fp );
+
+  long total = 0;
+  for ( int t = 0; t < PATTERN_KINDS; t++ )
+    total += totals[ t ].cycles;
+
+  fprintf( fp, "\n%-14s %6s %10s %14s %6s %12s\n", "type", "nodes", "calls",
+           "self cycles", "%", "cells" );
+  for ( int t = 0; t < PATTERN_KINDS; t++ ) {
+    if ( nodes[ t ] )
+      fprintf( fp, "%-14s %6d %10ld %14ld %5.1f%% %12ld\n",
+               patternTypes[ t ].name, nodes[ t ], totals[ t ].calls,
+               totals[ t ].cycles,
+               total ? 100.0 * totals[ t ].cycles / total : 0.0,
+               totals[ t ].cells );
   }
-  
-  return (Pattern *) this;
 }
@@ -13,7 +13,15 @@
 #ifndef PATTERN_H
 #define PATTERN_H
 
+#include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "nfa.h"
+
+/** Longest input string a pattern can fill in match tables for.  A
+    table takes about len * len / 8 bytes, so a longer string has to be
+    matched with an automaton instead. */
+#define MAX_TABLE_LENGTH 16384
 
 //////////////////////////////////////////////////////////////////////
 // Superclass for Patterns
@@ -21,6 +29,74 @@
 /** A short name to use for the Pattern interface. */
 typedef struct PatternStruct Pattern;
 
+/** Tags for the concrete pattern types.  Every pattern records its
+    type in its kind field, so code that has to treat one type
+    specially can check the tag instead of comparing method pointers
+    that a profiled pattern may have replaced. */
+typedef enum {
+  SYMBOL_PATTERN,
+  LITERAL_PATTERN,
+  CONCATENATION_PATTERN,
+  METACHAR_PATTERN,
+  CHAR_CLASS_PATTERN,
+  ALTERNATION_PATTERN,
+  REPETITION_PATTERN,
+  CAPTURE_PATTERN,
+  AUTOMATON_PATTERN,
+  SET_PATTERN,
+  PREFILTER_PATTERN,
+  CASELESS_PATTERN,
+
+  /** Number of pattern types, not a type itself. */
+  PATTERN_KINDS
+} PatternKind;
+
+/** Counters describing the work a pattern has done. */
+typedef struct {
+  /** Number of times a table was needed for a new input string. */
+  long requests;
+
+  /** Number of those times the existing table was already big enough. */
+  long reuses;
+
+  /** Total number of bytes allocated for tables. */
+  long bytes;
+
+  /** Number of input strings checked by a literal prefilter. */
+  long lines;
+
+  /** Number of those strings the prefilter rejected without matching. */
+  long rejected;
+
+  /** Number of calls to locate(), counted only while profiling. */
+  long calls;
+
+  /** Processor cycles spent in locate(), including the time for any
+      subpatterns, counted only while profiling. */
+  long cycles;
+
+  /** Number of match table cells set by locate(), counted only while
+      profiling. */
+  long cells;
+} PatternStats;
+
+/** Information about the literal strings that must appear in any match
+    of a pattern, used to quickly skip strings that can't match. */
+typedef struct {
+  /** If the pattern can only match one string, this is that string.
+      Otherwise, it's NULL. */
+  char *exact;
+
+  /** A string every match must start with. */
+  char *prefix;
+
+  /** A string every match must end with. */
+  char *suffix;
+
+  /** The longest string we've found that every match must contain. */
+  char *required;
+} LiteralInfo;
+
 /**
   Structure used as a superclass/interface for a regular expression
   pattern.  It includes a representation for a resizable 2D table
@@ -31,16 +107,32 @@ typedef struct PatternStruct Pattern;
   overridable method for freeing resources for the pattern.
 */
 struct PatternStruct {
+  /** Concrete type of this pattern, set by its constructor. */
+  PatternKind kind;
+
   /** Length of the current input string, as recorded by the latest call
       to locate(). */
   int len;
   
-  /** The match table, a (len + 1) X (len + 1) 2D array represented as
-      an array of pointers to arrays.  The job of the locate() functon
-      is to fill in this table so table[ begin ][ end ] is true if
-      this pattern can match the [ begiin, end ) substring of the
-      current input string.  */
-  bool **table;
+  /** The match table, a (len + 1) X (len + 1) 2D array of bits
+      stored in one block of memory, with each row taking up words
+      64-bit words.  The job of the locate() functon is to fill in
+      this table so bit end % 64 of word end / 64 in row begin is set
+      if this pattern can match the [ begin, end ) substring of the
+      current input string.  Storing a row as words lets patterns
+      combine the tables of their subpatterns 64 cells at a time.  */
+  uint64_t *table;
+
+  /** Number of 64-bit words in each row of the match table. */
+  int words;
+
+  /** Number of 64-bit words allocated for the match table.  The table
+      is kept from one call to locate() to the next, and it's only
+      reallocated when a longer input string needs more room. */
+  size_t capacity;
+
+  /** Counters for the work this pattern has done. */
+  PatternStats stats;
 
   /** Relallocate the match table.  Find all the [ begin, end )
       substrings of input string, str, that match the pattern.  For
@@ -53,6 +145,74 @@ struct PatternStruct {
   */
   void (*locate)( Pattern *pat, char const *str );
 
+  /** Find the leftmost-longest substring of the most recent input
+      string that matches this pattern and begins at or after index
+      from.  If there are several matches that begin at the same
+      place, this reports the longest one.  This can be called after
+      the pattern's locate() function.
+
+      @param pat pointer to the pattern being matched.
+      @param from first index where the match may begin.
+      @param begin returns the index of the first character in the match.
+      @param end returns the index one past the end of the match.
+      @return true if a match was found.
+  */
+  bool (*search)( Pattern *pat, int from, int *begin, int *end );
+
+  /** Report whether this pattern matches anywhere in the given input
+      string.  This doesn't need to call locate() first, and it can
+      stop as soon as it knows there's a match, so it's the fastest
+      way to pick out matching lines.  Afterward, search() can only be
+      used if locate() is called again.
+
+      @param pat pointer to the pattern being matched.
+      @param str input string to check.
+      @return true if some substring of str matches the pattern.
+  */
+  bool (*test)( Pattern *pat, char const *str );
+
+  /** Add states to the given automaton so it matches the same strings
+      as this pattern.  States are added back-to-front, so this
+      pattern's states lead to the given next state after a match.
+
+      @param pat pointer to the pattern being compiled.
+      @param nfa automaton we're adding states to.
+      @param next state to move to after this pattern has matched.
+      @return index of the first state for this pattern.
+  */
+  int (*compile)( Pattern *pat, Nfa *nfa, int next );
+
+  /** Call the given function for this pattern and for every subpattern
+      it contains.
+
+      @param pat pointer to the pattern being visited.
+      @param fn function to call for each pattern.
+      @param data extra value passed along to each call to fn.
+  */
+  void (*visit)( Pattern *pat, void (*fn)( Pattern *pat, void *data ),
+                 void *data );
+
+  /** Make a copy of this pattern, including copies of any subpatterns
+      it contains.  The copy has its own match tables, so it can be
+      used at the same time as the original, e.g., by another thread.
+      Compiled automata aren't changed by matching, so they aren't
+      copied or recompiled; the copy shares their states and just gets
+      its own scratch space for simulating them.
+
+      @param pat pointer to the pattern being copied.
+      @return a dynamically allocated copy of the pattern.
+  */
+  Pattern *(*clone)( Pattern *pat );
+
+  /** Find literal strings that must appear in every match of this
+      pattern.  The strings stored in info are dynamically allocated
+      and should be freed by the caller.
+
+      @param pat pointer to the pattern being analyzed.
+      @param info returns literal strings for the pattern.
+  */
+  void (*analyze)( Pattern *pat, LiteralInfo *info );
+
   /** Free memory for this pattern, including any subpatterns it contains.
       @param pat pattern to free.
   */
@@ -73,6 +233,219 @@ struct PatternStruct {
  */
 bool matches( Pattern *pat, int begin, int end );
 
+/** Type for a function that's called for each match findMatches() reports.
+
+    @param begin index of the first character in the match.
+    @param end index one past the end of the match.
+    @param data extra value passed along to findMatches().
+*/
+typedef void (*MatchHandler)( int begin, int end, void *data );
+
+/** Find the leftmost-longest matches of the pattern in the given string,
+    calling the handler for each one in order from left to right.  The
+    matches don't overlap, and an empty match right after the end of
+    the previous match isn't reported.  This calls the pattern's
+    locate() function, then finds the matches with its search()
+    function, without looking at its match table.
+
+    @param pat pattern to find matches for.
+    @param str input string to find matches in.
+    @param handler function to call for each match.
+    @param data extra value passed along to each call to handler.
+    @return the number of matches reported.
+ */
+int findMatches( Pattern *pat, char const *str, MatchHandler handler,
+                 void *data );
+
+/** Add up the counters for the given pattern and all of its subpatterns.
+
+    @param pat pattern to report counters for.
+    @param stats returns the total of all the counters.
+ */
+void patternStats( Pattern *pat, PatternStats *stats );
+
+/** Add the counters in one set of statistics to another.
+
+    @param total statistics to add to.
+    @param stats statistics to add.
+ */
+void addPatternStats( PatternStats *total, PatternStats const *stats );
+
+/**
+ * Method that creates a pattern that matches the same strings as the
+ * given pattern, but does its matching by simulating an automaton
+ * compiled from that pattern rather than filling in match tables.
+ * This lets the pattern check a string in time linear in its length.
+ * The new pattern doesn't keep a match table, so matches() can't be
+ * used with it; use its search() method instead.
+ *
+ * @param pat the pattern to compile, which becomes part of the new pattern
+ * and is freed when it is.
+ * @return a dynamically allocated representation for the automaton pattern
+ */
+Pattern *makeAutomatonPattern( Pattern *pat );
+
+/**
+ * Method that creates a pattern that matches any of the given patterns,
+ * all compiled into one automaton.  Pattern i in the list has ID i, and
+ * matchedPatterns() can report the IDs of every pattern that matches a
+ * string in a single pass over it.  Like makeAutomatonPattern(), the
+ * new pattern doesn't keep a match table.
+ *
+ * @param pats the list of patterns, which become part of the new
+ * pattern and are freed when it is.  The list itself isn't kept.
+ * @param count the number of patterns, at least one.
+ * @return a dynamically allocated representation for the pattern set
+ */
+Pattern *makePatternSet( Pattern **pats, int count );
+
+/**
+ * Method that creates a pattern set from an automaton that was compiled
+ * earlier, e.g., by makePatternSet() in a previous run of the program.
+ * The set works like one made by makePatternSet(), with the automaton's
+ * match state IDs as pattern IDs, but it doesn't have the patterns the
+ * automaton came from.
+ *
+ * @param nfa the automaton, which becomes part of the new pattern and
+ * is freed when it is.
+ * @param literal a string every match must contain, or NULL (or an
+ * empty string) if there isn't one.  The new pattern makes a copy.
+ * @return a dynamically allocated representation for the pattern set
+ */
+Pattern *makeCompiledPattern( Nfa *nfa, char const *literal );
+
+/**
+ * Function that returns the automaton that does the matching for a
+ * pattern set.
+ *
+ * @param pat a pattern made by makePatternSet() or makeCompiledPattern().
+ * @return the pattern's automaton, which still belongs to the pattern.
+ */
+Nfa const *patternSetAutomaton( Pattern *pat );
+
+/**
+ * Function that finds which patterns in a set match somewhere in the
+ * given string.
+ *
+ * @param pat a pattern made by makePatternSet() or makeCompiledPattern(),
+ * maybe inside a prefilter or a caseless pattern.
+ * @param str the string to check.
+ * @param ids returns a pointer to the IDs of the patterns that
+ * matched, in increasing order.  These stay valid until the next call
+ * for the same pattern.
+ * @return the number of patterns that matched.
+ */
+int matchedPatterns( Pattern *pat, char const *str, int const **ids );
+
+/**
+ * Function that finds where the capture groups are in a match of an
+ * automaton pattern, like one found by findMatches().  It can be
+ * called after the pattern's locate() function, for any match its
+ * search() function reported.
+ *
+ * @param pat a pattern made by makeAutomatonPattern(), maybe inside a
+ * prefilter pattern and a caseless pattern.
+ * @param begin index of the first character in the match.
+ * @param end index one past the end of the match.
+ * @param caps returns where each group begins and ends, with group n
+ * starting at caps[ 2n ] and ending at caps[ 2n + 1 ], or -1 for a group
+ * that isn't part of the match.  Group 0 is the whole match.
+ * @param slots number of values in caps.
+ * @return true if the captures were found.
+ */
+bool matchCaptures( Pattern *pat, int begin, int end, int *caps, int slots );
+
+/**
+ * Function that returns the automaton that does the matching for an
+ * automaton pattern or a pattern set, so it can be used directly, like
+ * for a stream made by makeNfaStream().
+ *
+ * @param pat the pattern, maybe inside a prefilter pattern and a
+ * caseless pattern.
+ * @return the pattern's automaton, which still belongs to the pattern,
+ * or NULL for a pattern that matches with tables.
+ */
+Nfa *patternAutomaton( Pattern *pat );
+
+/**
+ * Method that creates a pattern that checks each input string for a
+ * literal string that every match of the given pattern must contain,
+ * before doing any other matching.  Strings without the literal are
+ * rejected right away, using a fast library search (memchr() or
+ * strstr()) instead of the pattern's locate() function.  The number
+ * of strings checked and rejected is kept in the pattern's stats.
+ *
+ * @param pat the pattern to check strings for, which becomes part of
+ * the new pattern and is freed when it is.
+ * @return a dynamically allocated representation for the prefilter
+ * pattern, or pat itself if it has no required literal string.
+ */
+Pattern *makePrefilterPattern( Pattern *pat );
+
+/**
+ * Method that creates a pattern that ignores the case of ASCII letters,
+ * by folding each input string to lowercase with a lookup table and
+ * having the given pattern match the folded string.  The pattern should
+ * be parsed with PARSE_IGNORE_CASE, so its letters are lowercase too.
+ * Any automaton the pattern uses is folded so it accepts both cases,
+ * so it can also be used on input that hasn't been folded, like by
+ * matchedPatterns() or a stream.
+ *
+ * @param pat the pattern to match folded strings, which becomes part
+ * of the new pattern and is freed when it is.  A prefilter for it
+ * should go inside the new pattern, so it checks the folded string.
+ * @return a dynamically allocated representation for the caseless
+ * pattern
+ */
+Pattern *makeCaselessPattern( Pattern *pat );
+
+/**
+ * Function that finds the longest literal string that every match of
+ * the given pattern must contain, the same one a prefilter would check
+ * for.
+ *
+ * @param pat the pattern to analyze.
+ * @return a dynamically allocated copy of the literal, which is empty
+ * if there isn't one.
+ */
+char *requiredLiteral( Pattern *pat );
+
+/**
+ * Function that rewrites a tree of patterns made by the parser into a
+ * smaller tree that matches the same substrings. Runs of symbols are
+ * folded into literal strings, common prefixes are hoisted out of
+ * alternations, single-character alternatives are merged into a
+ * character class, and nested repetitions like (a*)+ are collapsed.
+ * Every pattern removed saves a table and a call to locate() for each
+ * string the tree is matched against.
+ *
+ * @param pat the pattern to optimize, which is used in the new tree or
+ * freed.
+ * @return the optimized pattern.
+ */
+Pattern *optimizePattern( Pattern *pat );
+
+/**
+ * Function that starts profiling every pattern in a tree.  Each
+ * pattern's locate() function is replaced with one that calls the
+ * original and adds up the number of calls, the processor cycles they
+ * take and the number of match table cells they set in the pattern's
+ * stats.  Copies of the tree made with clone() aren't profiled.
+ *
+ * @param pat the root of the tree to profile.
+ */
+void profilePattern( Pattern *pat );
+
+/**
+ * Function that prints the tree of a profiled pattern, with the
+ * counters for each pattern, followed by the totals for each type of
+ * pattern.
+ *
+ * @param pat the root of a tree passed to profilePattern().
+ * @param fp the stream to print to.
+ */
+void printProfile( Pattern *pat, FILE *fp );
+
 /**
   Make a pattern for a single, non-special character, like `a` or `5`.
 
@@ -93,6 +466,18 @@ Pattern *makeSymbolPattern( char sym );
 */
 Pattern *makeConcatenationPattern( Pattern *p1, Pattern *p2 );
 
+/**
+  Make a pattern for the concatenation of a list of patterns, in order.
+  The patterns are joined in a balanced tree of concatenations, rather
+  than a chain, so even a long, machine-generated pattern makes a tree
+  only about log2( count ) levels deep for the methods that walk it.
+
+  @param pats Subpatterns to concatenate, in order.
+  @param count Number of subpatterns, at least 1.
+  @return A dynamically allocated representation for this new pattern.
+*/
+Pattern *makeConcatenationList( Pattern **pats, int count );
+
 /**
  * Method that creates a metacharacter pattern. The metacharacter that
  * will be supported includes special characters like '.', '$', and '^'.
@@ -115,6 +500,20 @@ Pattern *makeMetacharPattern( char metachar );
  */
 Pattern *makeCharClassPattern( char *str );
 
+/**
+ * Method that creates a pattern for a character class in a pattern
+ * that ignores case, for matching input that's been folded to
+ * lowercase.  A lowercase letter is in the class if either case of it
+ * is in the class as written (or, for an inverted class like [^a], if
+ * neither case is left out), and capital letters are left out, since
+ * folded input doesn't have any.
+ *
+ * @param str the string that represents the character class pattern
+ * @return a dynamically allocated representation for the character class
+ * pattern
+ */
+Pattern *makeFoldedCharClassPattern( char *str );
+
 /**
  * Method that creates a pattern for the alternation between two pattern types.
  * This pattern should match anything that matches with either one of the two
@@ -127,17 +526,40 @@ Pattern *makeCharClassPattern( char *str );
  */
 Pattern *makeAlternationPattern( Pattern *p1, Pattern *p2 );
 
+/**
+ * Method that creates a pattern for the alternation between all the
+ * patterns in a list, joined in a balanced tree like the one
+ * makeConcatenationList() builds.
+ *
+ * @param pats the alternatives
+ * @param count the number of alternatives, at least 1
+ * @return a dynamically allocated representation for the alternation
+ * pattern
+ */
+Pattern *makeAlternationList( Pattern **pats, int count );
+
 /**
  * Method that creates a pattern for the repetition of a preceding pattern.
- * This pattern should match 0, 1, or possibly multiple occurrences of a given
- * string to match, depending on the repetition pattern. The repetition pattern
- * that will be supported includes '*', '+', and '?'.
+ * This pattern should match between min and max consecutive occurrences
+ * of the given pattern. The '*', '+' and '?' operators are the ranges
+ * {0,}, {1,} and {0,1}.
  *
  * @param pat the pointer to the pattern being matched
- * @param rpat the pointer to the repetition pattern represented
- * as a single character
+ * @param min the minimum number of occurrences
+ * @param max the maximum number of occurrences, or -1 if there's no maximum
  * @return a dynamically allocated representation for the repetition pattern
  */
-Pattern *makeRepetitionPattern( Pattern *pat, char *rpat );
+Pattern *makeRepetitionPattern( Pattern *pat, int min, int max );
+
+/**
+ * Method that creates a pattern for a capture group, which matches the
+ * same substrings as the pattern inside it, but also records where
+ * that pattern matched when it's compiled into an automaton.
+ *
+ * @param pat the pattern inside the group
+ * @param group the number of the group, counting from 1
+ * @return a dynamically allocated representation for the capture pattern
+ */
+Pattern *makeCapturePattern( Pattern *pat, int group );
 
 #endif
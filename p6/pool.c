@@ -0,0 +1,98 @@
+/**
+ * Component program for a pool of match contexts for one compiled
+ * pattern.  Idle contexts are kept on a stack, and a lock protects just
+ * the stack, so it's only held long enough to push or pop a context.
+ * New contexts are cloned from the pattern without the lock, since
+ * cloning only reads the pattern.
+ *
+ * @file pool.c
+ * @author Jimmy Nguyen (jnguyen6)
+ */
+
+#include "pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/** Initial capacity of the stack of idle contexts. */
+#define INITIAL_CAPACITY 8
+
+/** Representation for a pool of contexts. */
+struct PatternPoolStruct {
+  /** Compiled pattern the contexts are cloned from. */
+  Pattern *pat;
+
+  /** Stack of contexts that aren't in use. */
+  Pattern **idle;
+
+  /** Number of contexts on the stack. */
+  int count;
+
+  /** Capacity of the stack. */
+  int capacity;
+
+  /** Lock protecting the stack. */
+  pthread_mutex_t lock;
+};
+
+// Documented in the header.
+PatternPool *makePatternPool( Pattern *pat )
+{
+  PatternPool *pool = (PatternPool *) malloc( sizeof( PatternPool ) );
+  pool->pat = pat;
+  pool->count = 0;
+  pool->capacity = INITIAL_CAPACITY;
+  pool->idle = (Pattern **) malloc( pool->capacity * sizeof( Pattern * ) );
+  pthread_mutex_init( &pool->lock, NULL );
+  return pool;
+}
+
+// Documented in the header.
+Pattern *acquireContext( PatternPool *pool )
+{
+  Pattern *ctx = NULL;
+  pthread_mutex_lock( &pool->lock );
+  if ( pool->count > 0 )
+    ctx = pool->idle[ --pool->count ];
+  pthread_mutex_unlock( &pool->lock );
+
+  if ( !ctx )
+    ctx = pool->pat->clone( pool->pat );
+  return ctx;
+}
+
+// Documented in the header.
+void releaseContext( PatternPool *pool, Pattern *ctx )
+{
+  pthread_mutex_lock( &pool->lock );
+  if ( pool->count >= pool->capacity ) {
+    pool->capacity *= 2;
+    pool->idle = (Pattern **) realloc( pool->idle,
+                                       pool->capacity * sizeof( Pattern * ) );
+  }
+  pool->idle[ pool->count++ ] = ctx;
+  pthread_mutex_unlock( &pool->lock );
+}
+
+// Documented in the header.
+void poolStats( PatternPool *pool, PatternStats *stats )
+{
+  memset( stats, 0, sizeof( PatternStats ) );
+  pthread_mutex_lock( &pool->lock );
+  for ( int i = 0; i < pool->count; i++ ) {
+    PatternStats ctxStats;
+    patternStats( pool->idle[ i ], &ctxStats );
+    addPatternStats( stats, &ctxStats );
+  }
+  pthread_mutex_unlock( &pool->lock );
+}
+
+// Documented in the header.
+void freePatternPool( PatternPool *pool )
+{
+  for ( int i = 0; i < pool->count; i++ )
+    pool->idle[ i ]->destroy( pool->idle[ i ] );
+  free( pool->idle );
+  pthread_mutex_destroy( &pool->lock );
+  free( pool );
+}
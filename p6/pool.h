@@ -0,0 +1,64 @@
+/**
+ * Header file for the pool.c component, which hands out match contexts
+ * for one compiled pattern to any number of threads.  A context is a
+ * clone of the pattern, sharing its compiled automata but with its own
+ * match tables and scratch space, so threads can match at the same time
+ * without locking or parsing and compiling the pattern again.  Contexts
+ * are given back to the pool when a thread is done with them, and
+ * handed out again to the next thread that needs one.
+ *
+ * @file pool.h
+ * @author Jimmy Nguyen (jnguyen6)
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include "pattern.h"
+
+/** Short name for the pool type. */
+typedef struct PatternPoolStruct PatternPool;
+
+/** Make an empty pool of match contexts for the given pattern.  The
+    pattern itself is never handed out, and shouldn't be used to match
+    while contexts from the pool are in use.
+
+    @param pat compiled pattern the contexts are for.  It still belongs
+               to the caller, and has to outlive the pool.
+    @return a dynamically allocated pool.
+*/
+PatternPool *makePatternPool( Pattern *pat );
+
+/** Get a match context from the pool, making a new one if they're all
+    in use.  This can be called by any thread.
+
+    @param pool pool to get the context from.
+    @return a pattern matching the same strings as the pool's pattern,
+            which only the caller will use until it's released.
+*/
+Pattern *acquireContext( PatternPool *pool );
+
+/** Give a match context back to the pool, so it can be handed out
+    again.  This can be called by any thread.
+
+    @param pool pool the context came from.
+    @param ctx context to give back.
+*/
+void releaseContext( PatternPool *pool, Pattern *ctx );
+
+/** Add up the statistics for every context in the pool.  This should
+    be called once all the contexts have been released.
+
+    @param pool pool to report on.
+    @param stats returns the total statistics for the contexts.
+*/
+void poolStats( PatternPool *pool, PatternStats *stats );
+
+/** Free the pool and all the contexts in it.  The pool's pattern isn't
+    freed.  Every context should be released first.
+
+    @param pool pool to free.
+*/
+void freePatternPool( PatternPool *pool );
+
+#endif
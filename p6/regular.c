@@ -15,33 +15,785 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/resource.h>
 #include "pattern.h"
 #include "parse.h"
+#include "scan.h"
+#include "cache.h"
+#include "output.h"
 
-/** On the command line, which argument is the pattern. */
-#define PAT_ARG 1
+/** The minimum number of arguments after any options. */
+#define MIN_NUM_ARGS 1
 
-/** On the command line, which argument is the input file. */
-#define FILE_ARG 2
+/** The maximum number of arguments after any options. */
+#define MAX_NUM_ARGS 2
 
-/** The minimum number of valid arguments. */
-#define MIN_NUM_ARGS 2
+/** Initial capacity of the buffer used to hold a line of input. */
+#define INITIAL_CAPACITY 128
 
-/** The maximum number of valid arguments. */
-#define MAX_NUM_ARGS 3
+/** Number of bytes read at a time when the input is matched as a
+    stream. */
+#define STREAM_CHUNK ( 64 * 1024 )
+
+/** Escape sequence that starts highlighting a match in red. */
+#define COLOR_START "\033[31m"
+
+/** Escape sequence that ends highlighting. */
+#define COLOR_END "\033[0m"
+
+/** Length of a string literal, without its null terminator. */
+#define LITERAL_LEN( str ) ( sizeof( str ) - 1 )
+
+/** Print a usage message and exit unsuccessfully. */
+static void usage()
+{
+  fprintf( stderr, "usage: regular [options] <pattern> [input-file.txt]\n" );
+  exit( EXIT_FAILURE );
+}
 
 /**
- * The maximum number of characters that can be read from input,
- * including the new line character.
- */
-#define MAX_INPUT_LEN 101
+   Parse a pattern, printing an error message and exiting unsuccessfully
+   if it's invalid.
+
+   @param str string containing the pattern.
+   @param flags options for parsePatternFlags().
+   @param groups if it's not NULL, returns the number of groups in the
+                 pattern.
+   @return pointer to a representation of the pattern.
+*/
+static Pattern *parseValidPattern( char const *str, int flags, int *groups )
+{
+  Pattern *pat = parsePatternFlags( str, flags, groups );
+  if ( !pat ) {
+    fprintf( stderr, "Invalid pattern\n" );
+    exit( EXIT_FAILURE );
+  }
+  return pat;
+}
+
+/**
+   Read the next line of input into a resizable buffer, doubling the
+   capacity of the buffer as needed so lines can be of any length.
+   The newline at the end of the line isn't stored.  The last line of
+   a file doesn't need to end with a newline.
+
+   @param fp file to read from.
+   @param buffer pass-by-reference pointer to the buffer, which may
+                 be reallocated.
+   @param capacity pass-by-reference capacity of the buffer.
+   @return true if a line was read, false at the end of the file.
+*/
+static bool readLine( FILE *fp, char **buffer, int *capacity )
+{
+  int len = 0;
+  while ( fgets( *buffer + len, *capacity - len, fp ) ) {
+    len += strlen( *buffer + len );
+    if ( len > 0 && (*buffer)[ len - 1 ] == '\n' ) {
+      (*buffer)[ len - 1 ] = '\0';
+      return true;
+    }
+    if ( len + 1 >= *capacity ) {
+      *capacity *= 2;
+      *buffer = (char *) realloc( *buffer, *capacity );
+    }
+  }
+  return len > 0;
+}
+
+/** True if output lines should start with their byte offset in the
+    input.  This is set from the command line before any lines are
+    matched, and only read after that. */
+static bool showOffsets = false;
+
+/** Number of capture groups in the pattern, when fields are being
+    extracted.  Like showOffsets, this is only set before any lines are
+    matched. */
+static int captureGroups = 0;
+
+/** Flags for parsing patterns, PARSE_IGNORE_CASE for -i.  Like
+    showOffsets, this is only set before any lines are matched. */
+static int parseFlags = 0;
+
+/** Record written for each match with --binary.  Fields are in the
+    machine's own byte order. */
+typedef struct {
+  /** Line number of the line the match is in, starting from 1. */
+  uint64_t number;
+
+  /** Byte offset of the start of the line in the input. */
+  uint64_t offset;
+
+  /** Index in the line of the first character of the match. */
+  uint32_t begin;
+
+  /** Index in the line one past the end of the match. */
+  uint32_t end;
+} MatchRecord;
+
+/** State for printing the matches in one line of input. */
+typedef struct {
+  /** The line of input. */
+  char const *input;
+
+  /** Line number of the line in the input. */
+  long number;
+
+  /** Byte offset of the start of the line in the input. */
+  long offset;
+
+  /** Index of the next character of the line to print. */
+  int pos;
+
+  /** True once we've started printing the line. */
+  bool started;
+
+  /** Output to print to. */
+  Output *out;
+
+  /** Pattern that found the matches. */
+  Pattern *pat;
+} LineOutput;
+
+/**
+   Print the part of the line before the given match and then the match
+   itself, highlighted in red.  This is a MatchHandler for findMatches().
+
+   @param begin start of the match.
+   @param end end of the match.
+   @param data pointer to the LineOutput for the line.
+*/
+static void highlightMatch( int begin, int end, void *data )
+{
+  LineOutput *line = (LineOutput *) data;
+
+  if ( !line->started ) {
+    if ( showOffsets ) {
+      writeNumber( line->out, line->offset );
+      writeChar( line->out, ':' );
+    }
+    line->started = true;
+  }
+
+  //Special case: if we have found a match, but that match is a new line
+  //character (empty line). If there happens to be an empty line, do not
+  //"highlight" that line.
+  if ( line->input[ 0 ] == '\0' ) {
+    return;
+  }
+
+  writeBytes( line->out, line->input + line->pos, begin - line->pos );
+  writeBytes( line->out, COLOR_START, LITERAL_LEN( COLOR_START ) );
+  writeBytes( line->out, line->input + begin, end - begin );
+  writeBytes( line->out, COLOR_END, LITERAL_LEN( COLOR_END ) );
+  line->pos = end;
+}
+
+/**
+   Print the given match on a line by itself, without highlighting.
+   Empty matches aren't printed.  This is a MatchHandler for
+   findMatches().
+
+   @param begin start of the match.
+   @param end end of the match.
+   @param data pointer to the LineOutput for the line.
+*/
+static void printMatch( int begin, int end, void *data )
+{
+  LineOutput *line = (LineOutput *) data;
+
+  if ( begin == end ) {
+    return;
+  }
+  if ( showOffsets ) {
+    writeNumber( line->out, line->offset + begin );
+    writeChar( line->out, ':' );
+  }
+  writeBytes( line->out, line->input + begin, end - begin );
+  writeChar( line->out, '\n' );
+}
+
+/**
+   Print the parts of the given match captured by each group in the
+   pattern, separated by tabs, on a line by itself.  A group that isn't
+   part of the match prints as an empty field, and for a pattern without
+   groups, the whole match is printed.  Empty matches aren't printed.
+   This is a MatchHandler for findMatches().
+
+   @param begin start of the match.
+   @param end end of the match.
+   @param data pointer to the LineOutput for the line.
+*/
+static void extractMatch( int begin, int end, void *data )
+{
+  LineOutput *line = (LineOutput *) data;
+
+  if ( begin == end ) {
+    return;
+  }
+  int slots = 2 * ( captureGroups + 1 );
+  int caps[ slots ];
+  if ( !matchCaptures( line->pat, begin, end, caps, slots ) ) {
+    return;
+  }
+
+  if ( showOffsets ) {
+    writeNumber( line->out, line->offset + begin );
+    writeChar( line->out, ':' );
+  }
+  int first = captureGroups ? 1 : 0;
+  for ( int g = first; g <= captureGroups; g++ ) {
+    if ( g > first ) {
+      writeChar( line->out, '\t' );
+    }
+    if ( caps[ 2 * g ] >= 0 && caps[ 2 * g + 1 ] >= 0 ) {
+      writeBytes( line->out, line->input + caps[ 2 * g ],
+                  caps[ 2 * g + 1 ] - caps[ 2 * g ] );
+    }
+  }
+  writeChar( line->out, '\n' );
+}
+
+/**
+   Add a match to the list of matches in a JSON object, as a
+   two-element array of its start and end.  This is a MatchHandler for
+   findMatches().
+
+   @param begin start of the match.
+   @param end end of the match.
+   @param data pointer to the LineOutput for the line.
+*/
+static void jsonMatch( int begin, int end, void *data )
+{
+  LineOutput *line = (LineOutput *) data;
+
+  if ( !line->started ) {
+    writeString( line->out, "{\"line\":" );
+    writeNumber( line->out, line->number );
+    writeString( line->out, ",\"offset\":" );
+    writeNumber( line->out, line->offset );
+    writeString( line->out, ",\"matches\":[" );
+    line->started = true;
+  } else {
+    writeChar( line->out, ',' );
+  }
+  writeChar( line->out, '[' );
+  writeNumber( line->out, begin );
+  writeChar( line->out, ',' );
+  writeNumber( line->out, end );
+  writeChar( line->out, ']' );
+}
+
+/**
+   Write a binary record for a match.  This is a MatchHandler for
+   findMatches().
+
+   @param begin start of the match.
+   @param end end of the match.
+   @param data pointer to the LineOutput for the line.
+*/
+static void recordMatch( int begin, int end, void *data )
+{
+  LineOutput *line = (LineOutput *) data;
+  MatchRecord rec = { line->number, line->offset, begin, end };
+  writeBytes( line->out, &rec, sizeof( rec ) );
+}
+
+/**
+   Match the pattern against one line of input, and print the line
+   with every leftmost-longest match highlighted if there are any.
+
+   @param pat pattern to match.
+   @param input the line of input.
+   @param number line number of the line in the input.
+   @param offset byte offset of the start of the line in the input.
+   @param out output to print to.
+   @return true if the pattern matched the line.
+*/
+static bool processLine( Pattern *pat, char const *input, long number,
+                         long offset, Output *out )
+{
+  LineOutput line = { input, number, offset, 0, false, out, pat };
+  if ( findMatches( pat, input, highlightMatch, &line ) == 0 ) {
+    return false;
+  }
+  writeBytes( out, input + line.pos, pat->len - line.pos );
+  writeChar( out, '\n' );
+  return true;
+}
+
+/**
+   Check if the pattern matches one line of input, and print the line
+   without any highlighting if it does.  Since nothing is highlighted,
+   this doesn't need to find where the matches are.
+
+   @param pat pattern to match.
+   @param input the line of input.
+   @param number line number of the line in the input.
+   @param offset byte offset of the start of the line in the input.
+   @param out output to print to.
+   @return true if the pattern matched the line.
+*/
+static bool printLine( Pattern *pat, char const *input, long number,
+                       long offset, Output *out )
+{
+  if ( !pat->test( pat, input ) ) {
+    return false;
+  }
+  if ( showOffsets ) {
+    writeNumber( out, offset );
+    writeChar( out, ':' );
+  }
+  writeString( out, input );
+  writeChar( out, '\n' );
+  return true;
+}
+
+/**
+   Match the pattern against one line of input, and print each of its
+   non-empty matches on a line by itself.
+
+   @param pat pattern to match.
+   @param input the line of input.
+   @param number line number of the line in the input.
+   @param offset byte offset of the start of the line in the input.
+   @param out output to print to.
+   @return true if the pattern matched the line.
+*/
+static bool printOnlyMatches( Pattern *pat, char const *input, long number,
+                              long offset, Output *out )
+{
+  LineOutput line = { input, number, offset, 0, false, out, pat };
+  return findMatches( pat, input, printMatch, &line ) > 0;
+}
+
+/**
+   Match the pattern against one line of input, and print the fields
+   captured by its groups for each of its non-empty matches.
+
+   @param pat pattern to match.
+   @param input the line of input.
+   @param number line number of the line in the input.
+   @param offset byte offset of the start of the line in the input.
+   @param out output to print to.
+   @return true if the pattern matched the line.
+*/
+static bool printFields( Pattern *pat, char const *input, long number,
+                         long offset, Output *out )
+{
+  LineOutput line = { input, number, offset, 0, false, out, pat };
+  return findMatches( pat, input, extractMatch, &line ) > 0;
+}
+
+/**
+   Match the pattern against one line of input, and if there are any
+   matches, print a JSON object on a line by itself with the line
+   number, the byte offset of the line and the start and end of each
+   match in the line.
+
+   @param pat pattern to match.
+   @param input the line of input.
+   @param number line number of the line in the input.
+   @param offset byte offset of the start of the line in the input.
+   @param out output to print to.
+   @return true if the pattern matched the line.
+*/
+static bool printJson( Pattern *pat, char const *input, long number,
+                       long offset, Output *out )
+{
+  LineOutput line = { input, number, offset, 0, false, out, pat };
+  if ( findMatches( pat, input, jsonMatch, &line ) == 0 ) {
+    return false;
+  }
+  writeString( out, "]}\n" );
+  return true;
+}
+
+/**
+   Match the pattern against one line of input, and write a binary
+   MatchRecord for each match.
+
+   @param pat pattern to match.
+   @param input the line of input.
+   @param number line number of the line in the input.
+   @param offset byte offset of the start of the line in the input.
+   @param out output to write to.
+   @return true if the pattern matched the line.
+*/
+static bool writeRecords( Pattern *pat, char const *input, long number,
+                          long offset, Output *out )
+{
+  LineOutput line = { input, number, offset, 0, false, out, pat };
+  return findMatches( pat, input, recordMatch, &line ) > 0;
+}
+
+/** Handler that checkTableLine() passes each line on to. */
+static LineHandler tableHandler;
+
+/**
+   Check that a line isn't too long for the match tables used by the
+   -t engine, then pass it on to tableHandler.  Tables grow with the
+   square of the line length, so a longer line is an error.
+
+   @param pat pattern to match.
+   @param input the line of input.
+   @param number line number of the line.
+   @param offset byte offset of the start of the line.
+   @param out output to print to.
+   @return true if the pattern matched the line.
+*/
+static bool checkTableLine( Pattern *pat, char const *input, long number,
+                            long offset, Output *out )
+{
+  if ( strlen( input ) > MAX_TABLE_LENGTH ) {
+    flushOutput( out );
+    fprintf( stderr, "Input line too long for -t\n" );
+    exit( EXIT_FAILURE );
+  }
+  return tableHandler( pat, input, number, offset, out );
+}
+
+/**
+   Check if the pattern matches one line of input, without printing
+   anything or finding where the matches are.
+
+   @param pat pattern to match.
+   @param input the line of input.
+   @param number line number of the line (not used).
+   @param offset byte offset of the start of the line (not used).
+   @param out output to print to (not used).
+   @return true if the pattern matched the line.
+*/
+static bool testLine( Pattern *pat, char const *input, long number,
+                      long offset, Output *out )
+{
+  return pat->test( pat, input );
+}
+
+/**
+   Match a set of patterns against one line of input, and print the
+   line after the IDs of the patterns that matched it, if there are any.
+   IDs are the line numbers of the patterns in the pattern file, in a
+   comma-separated list.
+
+   @param pat pattern set to match.
+   @param input the line of input.
+   @param number line number of the line in the input.
+   @param offset byte offset of the start of the line in the input.
+   @param out output to print to.
+   @return true if any pattern matched the line.
+*/
+static bool printPatternIds( Pattern *pat, char const *input, long number,
+                             long offset, Output *out )
+{
+  int const *ids;
+  int count = matchedPatterns( pat, input, &ids );
+  if ( count == 0 ) {
+    return false;
+  }
+
+  if ( showOffsets ) {
+    writeNumber( out, offset );
+    writeChar( out, ':' );
+  }
+  for ( int i = 0; i < count; i++ ) {
+    if ( i ) {
+      writeChar( out, ',' );
+    }
+    writeNumber( out, ids[ i ] + 1 );
+  }
+  writeChar( out, ':' );
+  writeString( out, input );
+  writeChar( out, '\n' );
+  return true;
+}
+
+/**
+   Match a set of patterns against one line of input, and if any of
+   them match, print a JSON object on a line by itself with the line
+   number, the byte offset of the line and the IDs of the patterns that
+   matched.
+
+   @param pat pattern set to match.
+   @param input the line of input.
+   @param number line number of the line in the input.
+   @param offset byte offset of the start of the line in the input.
+   @param out output to print to.
+   @return true if any pattern matched the line.
+*/
+static bool printJsonIds( Pattern *pat, char const *input, long number,
+                          long offset, Output *out )
+{
+  int const *ids;
+  int count = matchedPatterns( pat, input, &ids );
+  if ( count == 0 ) {
+    return false;
+  }
+
+  writeString( out, "{\"line\":" );
+  writeNumber( out, number );
+  writeString( out, ",\"offset\":" );
+  writeNumber( out, offset );
+  writeString( out, ",\"patterns\":[" );
+  for ( int i = 0; i < count; i++ ) {
+    if ( i ) {
+      writeChar( out, ',' );
+    }
+    writeNumber( out, ids[ i ] + 1 );
+  }
+  writeString( out, "]}\n" );
+  return true;
+}
+
+/**
+   Print a match found in a stream on a line by itself, like
+   printMatch(), starting with its offset in the stream for -b.  Empty
+   matches aren't printed.  This is a StreamHandler for the stream's
+   automaton.
+
+   @param begin offset of the start of the match.
+   @param end offset of the end of the match.
+   @param text the characters of the match.
+   @param data pointer to the Output to print to.
+*/
+static void printStreamMatch( long begin, long end, char const *text,
+                              void *data )
+{
+  Output *out = (Output *) data;
+
+  if ( begin == end ) {
+    return;
+  }
+  if ( showOffsets ) {
+    writeNumber( out, begin );
+    writeChar( out, ':' );
+  }
+  writeBytes( out, text, end - begin );
+  writeChar( out, '\n' );
+}
+
+/**
+   Match the pattern against the whole input as a single stream, read a
+   chunk at a time, and print each non-empty match on its own line.
+   Output is flushed after every chunk, so matches in a file that's still
+   being written show up as soon as they're found.
+
+   @param fp file to read from.
+   @param pat pattern to match, which has to have an automaton.
+   @param out output to print to.
+*/
+static void matchStream( FILE *fp, Pattern *pat, Output *out )
+{
+  NfaStream *st = makeNfaStream( patternAutomaton( pat ), printStreamMatch,
+                                 out );
+  char *chunk = (char *) malloc( STREAM_CHUNK );
+  ssize_t n;
+  while ( ( n = read( fileno( fp ), chunk, STREAM_CHUNK ) ) > 0 ) {
+    nfaFeed( st, chunk, n );
+    flushOutput( out );
+    fflush( out->fp );
+  }
+  nfaFinish( st );
+  free( chunk );
+  freeNfaStream( st );
+}
+
+/**
+   Read a file with one pattern on each line.
+
+   @param filename name of the pattern file.
+   @param count returns the number of patterns in the file.
+   @return a dynamically allocated list of dynamically allocated
+           pattern strings.
+*/
+static char **readPatternFile( char const *filename, int *count )
+{
+  FILE *fp = fopen( filename, "r" );
+  if ( !fp ) {
+    fprintf( stderr, "Can't open pattern file: %s\n", filename );
+    exit( EXIT_FAILURE );
+  }
+
+  *count = 0;
+  int listCapacity = INITIAL_CAPACITY;
+  char **list = (char **) malloc( listCapacity * sizeof( char * ) );
+  int capacity = INITIAL_CAPACITY;
+  char *line = (char *) malloc( capacity );
+  while ( readLine( fp, &line, &capacity ) ) {
+    if ( *count >= listCapacity ) {
+      listCapacity *= 2;
+      list = (char **) realloc( list, listCapacity * sizeof( char * ) );
+    }
+    list[ ( *count )++ ] = strcpy( (char *) malloc( strlen( line ) + 1 ),
+                                   line );
+  }
+  free( line );
+  fclose( fp );
+
+  if ( *count == 0 ) {
+    usage();
+  }
+  return list;
+}
+
+/**
+   Parse a list of patterns and build a set that matches all of them in
+   one pass.  Like a pattern on the command line, an invalid pattern in
+   the list makes the program exit.
+
+   @param sources pattern strings to parse.
+   @param count number of patterns.
+   @return a dynamically allocated pattern set.
+*/
+static Pattern *buildPatternSet( char * const *sources, int count )
+{
+  Pattern **list = (Pattern **) malloc( count * sizeof( Pattern * ) );
+  for ( int i = 0; i < count; i++ ) {
+    list[ i ] = optimizePattern( parseValidPattern( sources[ i ], parseFlags,
+                                                    NULL ) );
+  }
+  Pattern *set = makePatternSet( list, count );
+  free( list );
+  return set;
+}
+
+/**
+   Build a pattern set for a list of patterns, using a compiled
+   automaton from the cache directory if there is one for exactly these
+   patterns, and saving the automaton there if there isn't.  A cache
+   file that can't be written just means the next run compiles the
+   patterns again.
+
+   @param dir directory holding cache files.
+   @param kind character that says how the patterns were given, so a
+               pattern file never shares a cache file with a pattern
+               on the command line.  It's in uppercase if case is
+               ignored, since the automaton is for folded input.
+   @param sources pattern strings.
+   @param count number of patterns.
+   @return a dynamically allocated pattern set.
+*/
+static Pattern *cachedPatternSet( char const *dir, char kind,
+                                  char * const *sources, int count )
+{
+  // The cache key is the kind, then each pattern on its own line.
+  size_t len = 2;
+  for ( int i = 0; i < count; i++ ) {
+    len += strlen( sources[ i ] ) + 1;
+  }
+  char *key = (char *) malloc( len + 1 );
+  char *end = key + sprintf( key, "%c\n", parseFlags & PARSE_IGNORE_CASE ?
+                            kind - 'a' + 'A' : kind );
+  for ( int i = 0; i < count; i++ ) {
+    end += sprintf( end, "%s\n", sources[ i ] );
+  }
+
+  char *path = cachePath( dir, key );
+  char *literal;
+  Nfa *nfa = loadCompiled( path, key, &literal );
+  Pattern *set;
+  if ( nfa ) {
+    set = makeCompiledPattern( nfa, literal );
+  } else {
+    set = buildPatternSet( sources, count );
+    literal = requiredLiteral( set );
+    saveCompiled( path, key, patternSetAutomaton( set ), literal );
+  }
+
+  free( literal );
+  free( path );
+  free( key );
+  return set;
+}
+
+/**
+   Print statistics about how the pattern did its matching to standard
+   error, along with the most memory the program has used.
+
+   @param pat pattern to report statistics for.
+   @param extra statistics from other copies of the pattern, to add to
+                the ones for pat.
+*/
+static void reportStats( Pattern *pat, PatternStats *extra )
+{
+  PatternStats stats;
+  patternStats( pat, &stats );
+  addPatternStats( &stats, extra );
+  fprintf( stderr, "tables: %ld requests, %ld reused (%.1f%%), "
+           "%ld bytes allocated\n", stats.requests, stats.reuses,
+           stats.requests ? 100.0 * stats.reuses / stats.requests : 0.0,
+           stats.bytes );
+  if ( stats.lines ) {
+    fprintf( stderr, "prefilter: %ld lines, %ld rejected (%.1f%%)\n",
+             stats.lines, stats.rejected,
+             100.0 * stats.rejected / stats.lines );
+  }
 
-/** The ASCII value that represents an escape sequence. */
-#define ASCII_ESC 27
+  struct rusage resources;
+  if ( getrusage( RUSAGE_SELF, &resources ) == 0 ) {
+    fprintf( stderr, "memory: %ld KB peak\n", resources.ru_maxrss );
+  }
+}
 
 /**
    Entry point for the program, parses command-line arguments, builds
-   the pattern and then tests it against lines of input.
+   the pattern and then tests it against lines of input, which can be
+   any length.  By default, the pattern is compiled into an automaton,
+   which needs memory proportional to the size of the pattern but not
+   the length of the line.  Options are:
+     -t  match using the pattern's match tables instead (these need
+         memory proportional to the square of the line length, so a
+         line longer than MAX_TABLE_LENGTH characters is an error).
+     -s  report statistics about the run to standard error.
+     -j <threads>  match the lines of the input file on the given
+         number of threads, with output in the original line order.
+     -c  just print the number of lines that match.
+     -l  just print the name of the input file if any line matches.
+     -o  print each non-empty match on its own line, instead of the
+         lines that contain them.
+     -b  start each line of output with the byte offset in the input
+         of the line (or of the match, with -o).
+     -f <pattern-file>  match all the patterns in the given file (one
+         per line) in a single pass, instead of a pattern given on the
+         command line.  Matching lines are printed after the list of
+         patterns that matched them.  Pattern sets are always matched
+         with an automaton, so -t doesn't apply.
+     -C <cache-dir>  save the automaton compiled for the pattern (or
+         pattern file) in the given directory, and reuse it instead of
+         compiling again if the same patterns are given later.  This
+         doesn't apply with -t, which doesn't use an automaton.
+     --json  instead of printing matching lines, print a JSON object on
+         a line by itself for each one, with its line number, the byte
+         offset of the line and a list of [start, end] pairs for the
+         matches in the line (or a list of pattern IDs, with -f).
+     --binary  instead of printing matching lines, write a MatchRecord
+         for each match.  This can't be used with -f, since pattern
+         sets don't find where their matches are.
+     --color=<when>  highlight matches in red always (the default),
+         never, or auto, only when standard output is a terminal.
+     -e, --extract  for each non-empty match, print the parts of it
+         captured by the pattern's parenthesized groups, separated by
+         tabs, on a line by itself.  Fields are always found with an
+         automaton, so -t and -C don't apply, and the pattern isn't
+         optimized, since that could change which way a match is split
+         into groups.  This can't be used with -f, --json or --binary.
+     --stream  match the whole input as one string, read a chunk at a
+         time, and print each non-empty match on its own line, like -o.
+         Matches can span lines, and ^ and $ only match at the start and
+         end of the input.  Memory isn't constant, but it's bounded by the
+         longest candidate match rather than the length of the input or
+         its lines.  A pattern like 'a.*b' keeps everything after an a
+         until it sees whether a b follows.  This always uses an
+         automaton, so -t and -j don't apply, and it can't be used with
+         -c, -l, -e, --json or --binary.
+     -i  ignore the case of ASCII letters.  The pattern is folded to
+         lowercase when it's parsed, and each line is folded the same
+         way before it's matched, so this is as fast as matching case.
+     -p  profile the calls to each subpattern's locate() function and
+         print the pattern tree with its counters to standard error
+         after the run.  Only the table engine (-t) calls locate() for
+         every subpattern, and profiling turns off -j.
 
    @param argc Number of command-line arguments.
    @param argv List of command-line arguments.
@@ -49,98 +801,212 @@
 */
 int main( int argc, char *argv[] )
 {
+  bool useTable = false;
+  bool showStats = false;
+  bool profile = false;
+  bool countOnly = false;
+  bool listFiles = false;
+  bool onlyMatching = false;
+  bool json = false;
+  bool binary = false;
+  bool color = true;
+  bool extract = false;
+  bool stream = false;
+  char const *patternFile = NULL;
+  char const *cacheDir = NULL;
+  int threads = 1;
+  int arg = 1;
+  while ( arg < argc && argv[ arg ][ 0 ] == '-' && argv[ arg ][ 1 ] ) {
+    if ( strcmp( argv[ arg ], "-t" ) == 0 ) {
+      useTable = true;
+    } else if ( strcmp( argv[ arg ], "-s" ) == 0 ) {
+      showStats = true;
+    } else if ( strcmp( argv[ arg ], "-i" ) == 0 ) {
+      parseFlags |= PARSE_IGNORE_CASE;
+    } else if ( strcmp( argv[ arg ], "-p" ) == 0 ) {
+      profile = true;
+    } else if ( strcmp( argv[ arg ], "-e" ) == 0
+                || strcmp( argv[ arg ], "--extract" ) == 0 ) {
+      extract = true;
+    } else if ( strcmp( argv[ arg ], "--stream" ) == 0 ) {
+      stream = true;
+    } else if ( strcmp( argv[ arg ], "-c" ) == 0 ) {
+      countOnly = true;
+    } else if ( strcmp( argv[ arg ], "-l" ) == 0 ) {
+      listFiles = true;
+    } else if ( strcmp( argv[ arg ], "-o" ) == 0 ) {
+      onlyMatching = true;
+    } else if ( strcmp( argv[ arg ], "-b" ) == 0 ) {
+      showOffsets = true;
+    } else if ( strcmp( argv[ arg ], "--json" ) == 0 ) {
+      json = true;
+    } else if ( strcmp( argv[ arg ], "--binary" ) == 0 ) {
+      binary = true;
+    } else if ( strcmp( argv[ arg ], "--color=always" ) == 0 ) {
+      color = true;
+    } else if ( strcmp( argv[ arg ], "--color=never" ) == 0 ) {
+      color = false;
+    } else if ( strcmp( argv[ arg ], "--color=auto" ) == 0 ) {
+      color = isatty( STDOUT_FILENO );
+    } else if ( strcmp( argv[ arg ], "-f" ) == 0 ) {
+      if ( arg + 1 >= argc ) {
+        usage();
+      }
+      patternFile = argv[ ++arg ];
+    } else if ( strcmp( argv[ arg ], "-C" ) == 0 ) {
+      if ( arg + 1 >= argc ) {
+        usage();
+      }
+      cacheDir = argv[ ++arg ];
+    } else if ( strcmp( argv[ arg ], "-j" ) == 0 ) {
+      if ( arg + 1 >= argc || sscanf( argv[ arg + 1 ], "%d", &threads ) != 1
+           || threads < 1 ) {
+        usage();
+      }
+      arg++;
+    } else if ( strcmp( argv[ arg ], "--" ) == 0 ) {
+      arg++;
+      break;
+    } else {
+      usage();
+    }
+    arg++;
+  }
 
-  if ( argc < MIN_NUM_ARGS || argc > MAX_NUM_ARGS ) {
-    fprintf( stderr, "usage: regular <pattern> [input-file.txt]\n" );
-    return EXIT_FAILURE;
+  // With a pattern file, there's no pattern argument.
+  int minArgs = patternFile ? MIN_NUM_ARGS - 1 : MIN_NUM_ARGS;
+  int maxArgs = patternFile ? MAX_NUM_ARGS - 1 : MAX_NUM_ARGS;
+  if ( argc - arg < minArgs || argc - arg > maxArgs
+       || ( binary && ( json || patternFile ) )
+       || ( extract && ( json || binary || patternFile ) )
+       || ( stream && ( countOnly || listFiles || extract || json
+                        || binary ) ) ) {
+    usage();
+  }
+  if ( stream ) {
+    useTable = false;
   }
   
   FILE *infile = NULL;
-  if ( argc == MAX_NUM_ARGS ) {
-    infile = fopen( argv[ FILE_ARG ], "r" );
+  char const *filename = "(standard input)";
+  if ( argc - arg == maxArgs ) {
+    filename = argv[ argc - 1 ];
+    infile = fopen( filename, "r" );
     if ( !infile ) {
-      fprintf( stderr, "Can't open input file: %s\n", argv[ FILE_ARG ] );
+      fprintf( stderr, "Can't open input file: %s\n", filename );
       return EXIT_FAILURE;
     }
   } else {
     infile = stdin;
   }
   
-  Pattern *pat = parsePattern( argv[ PAT_ARG ] );
-  char input[ MAX_INPUT_LEN + 1 ] = "";
-  while ( fgets( input, MAX_INPUT_LEN, infile ) ) {
-    if ( input[ strlen( input ) - 1 ] != '\n' ) {
-      fprintf( stderr, "Input line too long\n" );
-      return EXIT_FAILURE;
+  Pattern *pat;
+  if ( patternFile ) {
+    int count;
+    char **sources = readPatternFile( patternFile, &count );
+    if ( cacheDir ) {
+      pat = cachedPatternSet( cacheDir, 'f', sources, count );
+    } else {
+      pat = buildPatternSet( sources, count );
     }
-    
-    input[ strlen( input ) - 1 ] = '\0';
-    
-    pat->locate( pat, input );
-    
-    //First, check if we have found a match or not
-    bool foundMatch = false;
-    for ( int i = 0; i <= pat->len; i++ ) {
-      for ( int j = i; j <= pat->len; j++ ) {
-        if ( matches( pat, i, j ) ) {
-          foundMatch = true;
-        }
+    for ( int i = 0; i < count; i++ ) {
+      free( sources[ i ] );
+    }
+    free( sources );
+  } else {
+    if ( extract ) {
+      int flags = parseFlags | PARSE_CAPTURE;
+      pat = makeAutomatonPattern( parseValidPattern( argv[ arg ], flags,
+                                                     &captureGroups ) );
+    } else if ( cacheDir && !useTable ) {
+      // A set of one pattern matches just like the pattern.
+      pat = cachedPatternSet( cacheDir, 'p', argv + arg, 1 );
+    } else {
+      pat = optimizePattern( parseValidPattern( argv[ arg ], parseFlags,
+                                                NULL ) );
+      if ( !useTable ) {
+        pat = makeAutomatonPattern( pat );
       }
     }
-    
-    if ( foundMatch ) {
-      bool redTextOn = false;
-      foundMatch = false;
-      for ( int i = 0; i <= pat->len; i++ ) {
-        for ( int j = i; j <= pat->len; j++ ) {
-          if ( matches( pat, i, j ) ) {
-          //Special case: if we have found a match, but that match is a new line
-          //character (empty line). If there happens to be an empty line, do not
-          //"highlight" that line.
-            if ( pat->len == 0 ) {
-              break;
-            } else {
-              if ( !redTextOn ) {
-                printf( "%c%c%c%c%c", ASCII_ESC, '[', '3', '1', 'm' );
-                redTextOn = true;
-              }
-              foundMatch = true;
-              if ( j == pat->len ) {
-                int begin;
-                for ( begin = i; begin < j ; begin++ ) {
-                  printf( "%c", input[ begin ] );
-                }
-                i = begin;
-                j = i;
-                printf( "%c%c%c%c", ASCII_ESC, '[', '0', 'm' );
-                redTextOn = false;
-              }
-            }
-          } else {
-            if ( foundMatch ) {
-              int begin;
-              for ( begin = i; begin < j - 1; begin++ ) {
-                printf( "%c", input[ begin ] );
-              }
-              i = begin;
-              j = i;
-              foundMatch = false;
-            }
-            if ( redTextOn ) {
-                printf( "%c%c%c%c", ASCII_ESC, '[', '0', 'm' );
-                redTextOn = false;
-            }
-          }
-        }
-        if ( !foundMatch && i < pat->len ) {
-          printf( "%c", input[ i ] );
+    pat = makePrefilterPattern( pat );
+  }
+  if ( parseFlags & PARSE_IGNORE_CASE ) {
+    pat = makeCaselessPattern( pat );
+  }
+
+  // When we only need to know which lines match, don't find the matches.
+  LineHandler handler = processLine;
+  if ( countOnly || listFiles ) {
+    handler = testLine;
+  } else if ( json ) {
+    handler = patternFile ? printJsonIds : printJson;
+  } else if ( binary ) {
+    handler = writeRecords;
+  } else if ( extract ) {
+    handler = printFields;
+  } else if ( onlyMatching ) {
+    handler = printOnlyMatches;
+  } else if ( patternFile ) {
+    handler = printPatternIds;
+  } else if ( !color ) {
+    handler = printLine;
+  }
+
+  if ( useTable && !patternFile && !extract ) {
+    tableHandler = handler;
+    handler = checkTableLine;
+  }
+
+  // Clones of the pattern for other threads wouldn't be profiled.
+  if ( profile ) {
+    profilePattern( pat );
+    threads = 1;
+  }
+
+  Output out;
+  initOutput( &out, stdout, OUTPUT_CAPACITY );
+  PatternStats extra;
+  memset( &extra, 0, sizeof( extra ) );
+  long count = 0;
+  if ( stream ) {
+    matchStream( infile, pat, &out );
+  } else if ( threads == 1 || !scanParallel( infile, pat, threads, handler,
+                                      json || binary, &out, &extra,
+                                      &count ) ) {
+    int capacity = INITIAL_CAPACITY;
+    char *input = (char *) malloc( capacity );
+    long number = 1;
+    long offset = 0;
+    while ( readLine( infile, &input, &capacity ) ) {
+      bool matched = handler( pat, input, number++, offset, &out );
+      offset += strlen( input ) + 1;
+      if ( matched ) {
+        count++;
+        // One matching line is enough to list the file.
+        if ( listFiles ) {
+          break;
         }
       }
-      printf( "\n" );
     }
-    for ( int i = 0; input[ i ]; i++ ) {
-      input[ i ] = '\0';
+    free( input );
+  }
+
+  if ( listFiles ) {
+    if ( count ) {
+      writeString( &out, filename );
+      writeChar( &out, '\n' );
     }
+  } else if ( countOnly ) {
+    writeNumber( &out, count );
+    writeChar( &out, '\n' );
+  }
+  freeOutput( &out );
+
+  if ( showStats ) {
+    reportStats( pat, &extra );
+  }
+  if ( profile ) {
+    printProfile( pat, stderr );
   }
 
   pat->destroy( pat );
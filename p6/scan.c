@@ -0,0 +1,295 @@
+/**
+ * Component program that matches the lines of an input file on a pool
+ * of worker threads.  The input file is mapped into memory and split
+ * into chunks that end at newlines.  Workers take chunks in order,
+ * write results for each chunk into a memory buffer and mark it
+ * finished, while the main thread writes out finished buffers in
+ * chunk order.
+ *
+ * @file scan.c
+ * @author Jimmy Nguyen (jnguyen6)
+ */
+
+#include "scan.h"
+#include "pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** Smallest number of bytes of input in a chunk. */
+#define MIN_CHUNK_SIZE ( 64 * 1024 )
+
+/** Largest number of bytes of input in a chunk. */
+#define MAX_CHUNK_SIZE ( 4 * 1024 * 1024 )
+
+/** Number of chunks we try to make for each thread, so a thread that
+    gets slow chunks doesn't hold up the others. */
+#define CHUNKS_PER_THREAD 8
+
+/** Initial capacity of the buffer used to hold a line of input. */
+#define INITIAL_CAPACITY 128
+
+/** A part of the input file, along with the output for its lines. */
+typedef struct {
+  /** First byte of input for this chunk. */
+  char const *start;
+
+  /** Number of bytes of input in the chunk, including its last newline. */
+  size_t size;
+
+  /** Line number of the first line in the chunk. */
+  long number;
+
+  /** Output written for the lines in the chunk. */
+  Output out;
+
+  /** Number of lines in the chunk that the pattern matched. */
+  long matches;
+
+  /** True once a worker has finished this chunk. */
+  bool done;
+} Chunk;
+
+/** State shared by all the threads scanning a file. */
+typedef struct {
+  /** Start of the input file, mapped into memory. */
+  char const *data;
+
+  /** List of chunks to scan. */
+  Chunk *chunks;
+
+  /** Number of chunks. */
+  int count;
+
+  /** Index of the next chunk a worker should take. */
+  int next;
+
+  /** Match contexts for the pattern, one for each busy worker. */
+  PatternPool *pool;
+
+  /** Function to call for each line. */
+  LineHandler handler;
+
+  /** True if the handler is given line numbers. */
+  bool numbered;
+
+  /** Lock protecting next and the done field of each chunk. */
+  pthread_mutex_t lock;
+
+  /** Signaled whenever a worker finishes a chunk. */
+  pthread_cond_t finished;
+} ScanJob;
+
+/** State for one worker thread. */
+typedef struct {
+  /** The job the worker is helping with. */
+  ScanJob *job;
+
+  /** Thread running this worker. */
+  pthread_t thread;
+} Worker;
+
+/** Call the job's handler for every line in the given chunk, writing its
+    output to the chunk's output buffer.
+
+    @param job job the chunk is part of.
+    @param pat pattern to use for matching.
+    @param chunk chunk to scan.
+    @param line pass-by-reference buffer for holding a line of input.
+    @param capacity pass-by-reference capacity of the line buffer.
+*/
+static void scanChunk( ScanJob *job, Pattern *pat, Chunk *chunk,
+                       char **line, size_t *capacity )
+{
+  initOutput( &chunk->out, NULL, INITIAL_CAPACITY );
+  long number = chunk->number;
+  char const *pos = chunk->start;
+  char const *end = chunk->start + chunk->size;
+  while ( pos < end ) {
+    char const *newline = (char const *) memchr( pos, '\n', end - pos );
+    size_t len = newline ? newline - pos : end - pos;
+
+    // The pattern needs a null-terminated string, so copy the line.
+    if ( len + 1 > *capacity ) {
+      while ( len + 1 > *capacity )
+        *capacity *= 2;
+      *line = (char *) realloc( *line, *capacity );
+    }
+    memcpy( *line, pos, len );
+    ( *line )[ len ] = '\0';
+
+    if ( job->handler( pat, *line, number, pos - job->data, &chunk->out ) )
+      chunk->matches++;
+    if ( job->numbered )
+      number++;
+    pos += len + 1;
+  }
+}
+
+/** Start routine for a worker thread.  It takes a match context from
+    the job's pool and scans chunks with it until there aren't any left.
+
+    @param arg pointer to the Worker for this thread.
+    @return NULL
+*/
+static void *runWorker( void *arg )
+{
+  Worker *worker = (Worker *) arg;
+  ScanJob *job = worker->job;
+  Pattern *pat = acquireContext( job->pool );
+
+  size_t capacity = INITIAL_CAPACITY;
+  char *line = (char *) malloc( capacity );
+  while ( true ) {
+    pthread_mutex_lock( &job->lock );
+    int i = job->next++;
+    pthread_mutex_unlock( &job->lock );
+    if ( i >= job->count )
+      break;
+
+    scanChunk( job, pat, job->chunks + i, &line, &capacity );
+
+    pthread_mutex_lock( &job->lock );
+    job->chunks[ i ].done = true;
+    pthread_cond_broadcast( &job->finished );
+    pthread_mutex_unlock( &job->lock );
+  }
+  free( line );
+  releaseContext( job->pool, pat );
+  return NULL;
+}
+
+/** Count the newlines in part of the input.
+
+    @param start first byte to look at.
+    @param end end of the part to look at.
+    @return number of newlines.
+*/
+static long countLines( char const *start, char const *end )
+{
+  long count = 0;
+  while ( ( start = (char const *) memchr( start, '\n', end - start ) ) ) {
+    count++;
+    start++;
+  }
+  return count;
+}
+
+/** Split the given input into chunks of about the given size, with each
+    chunk ending right after a newline (or at the end of the input).
+    If asked, chunks are numbered with the line number of their first
+    line.
+
+    @param data start of the input.
+    @param size number of bytes of input.
+    @param target approximate number of bytes for each chunk.
+    @param numbered true if the chunks should be numbered.
+    @param count returns the number of chunks.
+    @return a dynamically allocated array of chunks.
+*/
+static Chunk *makeChunks( char const *data, size_t size, size_t target,
+                          bool numbered, int *count )
+{
+  int capacity = size / target + 1;
+  Chunk *chunks = (Chunk *) malloc( capacity * sizeof( Chunk ) );
+  *count = 0;
+
+  size_t pos = 0;
+  long number = numbered ? 1 : 0;
+  while ( pos < size ) {
+    size_t end = pos + target < size ? pos + target : size;
+    char const *newline = (char const *) memchr( data + end - 1, '\n',
+                                                 size - end + 1 );
+    end = newline ? newline - data + 1 : size;
+
+    if ( *count >= capacity ) {
+      capacity *= 2;
+      chunks = (Chunk *) realloc( chunks, capacity * sizeof( Chunk ) );
+    }
+    Chunk *c = chunks + ( *count )++;
+    c->start = data + pos;
+    c->size = end - pos;
+    c->number = number;
+    c->matches = 0;
+    c->done = false;
+    if ( numbered )
+      number += countLines( data + pos, data + end );
+    pos = end;
+  }
+  return chunks;
+}
+
+// Documented in the header.
+bool scanParallel( FILE *fp, Pattern *pat, int threads, LineHandler handler,
+                   bool numbered, Output *out, PatternStats *stats,
+                   long *count )
+{
+  struct stat info;
+  if ( fstat( fileno( fp ), &info ) != 0 || !S_ISREG( info.st_mode ) )
+    return false;
+
+  // There's nothing to map for an empty file.
+  size_t size = info.st_size;
+  if ( size == 0 )
+    return true;
+
+  char const *data = (char const *) mmap( NULL, size, PROT_READ, MAP_PRIVATE,
+                                          fileno( fp ), 0 );
+  if ( data == MAP_FAILED )
+    return false;
+  madvise( (void *) data, size, MADV_SEQUENTIAL );
+
+  size_t target = size / ( threads * CHUNKS_PER_THREAD );
+  if ( target < MIN_CHUNK_SIZE )
+    target = MIN_CHUNK_SIZE;
+  if ( target > MAX_CHUNK_SIZE )
+    target = MAX_CHUNK_SIZE;
+
+  ScanJob job;
+  job.data = data;
+  job.chunks = makeChunks( data, size, target, numbered, &job.count );
+  job.next = 0;
+  job.pool = makePatternPool( pat );
+  job.handler = handler;
+  job.numbered = numbered;
+  pthread_mutex_init( &job.lock, NULL );
+  pthread_cond_init( &job.finished, NULL );
+
+  Worker *workers = (Worker *) malloc( threads * sizeof( Worker ) );
+  for ( int i = 0; i < threads; i++ ) {
+    workers[ i ].job = &job;
+    pthread_create( &workers[ i ].thread, NULL, runWorker, workers + i );
+  }
+
+  // Write out each chunk's results as soon as it and all the chunks
+  // before it are finished.
+  for ( int i = 0; i < job.count; i++ ) {
+    pthread_mutex_lock( &job.lock );
+    while ( !job.chunks[ i ].done )
+      pthread_cond_wait( &job.finished, &job.lock );
+    pthread_mutex_unlock( &job.lock );
+
+    Chunk *chunk = job.chunks + i;
+    writeBytes( out, chunk->out.buffer, chunk->out.len );
+    *count += chunk->matches;
+    freeOutput( &chunk->out );
+  }
+
+  for ( int i = 0; i < threads; i++ )
+    pthread_join( workers[ i ].thread, NULL );
+  if ( stats ) {
+    PatternStats workerStats;
+    poolStats( job.pool, &workerStats );
+    addPatternStats( stats, &workerStats );
+  }
+  freePatternPool( job.pool );
+
+  free( workers );
+  free( job.chunks );
+  pthread_mutex_destroy( &job.lock );
+  pthread_cond_destroy( &job.finished );
+  munmap( (void *) data, size );
+  return true;
+}
@@ -0,0 +1,58 @@
+/**
+ * Header file for the scan.c component, which matches the lines of
+ * an input file on several threads at once.  The file is mapped into
+ * memory and split into chunks that end at line boundaries, each
+ * thread matches chunks with its own match context for the pattern,
+ * and the results are written out in the same order as the input
+ * lines.
+ *
+ * @file scan.h
+ * @author Jimmy Nguyen (jnguyen6)
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "pattern.h"
+#include "output.h"
+
+/** Type for a function that handles one line of input, writing any
+    results for the line to the given output.
+
+    @param pat pattern to match against the line.
+    @param line the line of input, without its newline.
+    @param number line number of the line in the input, starting from 1.
+    @param offset byte offset of the start of the line in the input.
+    @param out output where results for this line should be written.
+    @return true if the pattern matched the line.
+*/
+typedef bool (*LineHandler)( Pattern *pat, char const *line, long number,
+                             long offset, Output *out );
+
+/** Call the given handler for every line of the input file, using the
+    given number of threads.  Each thread gets its own match context
+    for the pattern from a pool, and output from the handler is written to the given output
+    in the same order as the input lines.
+
+    @param fp input file to scan.  This must be a regular file, so
+              it can be mapped into memory.
+    @param pat pattern to match.
+    @param threads number of threads to use.
+    @param handler function to call for each line of input.
+    @param numbered true if the handler needs line numbers.  Finding
+                    them takes an extra pass over the input, so without
+                    this the handler is given 0 for every line number.
+    @param out output for the results.
+    @param stats if this isn't NULL, the statistics for all of
+                 the threads' patterns are added to it.
+    @param count the number of lines the pattern matched is added to this.
+    @return false if the file couldn't be mapped into memory, in which
+            case nothing has been read from it.
+*/
+bool scanParallel( FILE *fp, Pattern *pat, int threads, LineHandler handler,
+                   bool numbered, Output *out, PatternStats *stats,
+                   long *count );
+
+#endif
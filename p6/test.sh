@@ -1,6 +1,10 @@
 #!/bin/bash
 FAIL=0
 
+# Optional flags passed to every run of the program, like -t to
+# check the match-table engine instead of the automaton.
+FLAGS="$1"
+
 # Make a fresh copy of the target program
 make clean
 make
@@ -64,8 +68,8 @@ checkResults() {
 runTest() {
   rm -f output.txt stderr.txt
 
-  echo "Test $1: ./regular '$2' input-$1.txt > output.txt 2> stderr.txt"
-  ./regular "$2" input-$1.txt > output.txt 2> stderr.txt
+  echo "Test $1: ./regular $FLAGS '$2' input-$1.txt > output.txt 2> stderr.txt"
+  ./regular $FLAGS "$2" input-$1.txt > output.txt 2> stderr.txt
   STATUS=$?
 
   checkResults "$1" "$3"
@@ -78,8 +82,8 @@ runTest 03 'c' 0
 runTest 04 'abc' 0
 runTest 05 'a.c' 0
 
-echo "Test 06: ./regular 'a..c' < input-06.txt > output.txt 2> stderr.txt"
-./regular 'a..c' < input-06.txt > output.txt 2> stderr.txt
+echo "Test 06: ./regular $FLAGS 'a..c' < input-06.txt > output.txt 2> stderr.txt"
+./regular $FLAGS 'a..c' < input-06.txt > output.txt 2> stderr.txt
 STATUS=$?
 checkResults 06 0
 
@@ -92,8 +96,8 @@ runTest 12 'ab+c' 0
 runTest 13 'ab?c' 0
 runTest 14 'a(bc)*d' 0
 
-echo "Test 15: ./regular '^Your (license|application|program) has been (revoked|accepted|tested)!$' input-15.txt > output.txt 2> stderr.txt"
-./regular '^Your (license|application|program) has been (revoked|accepted|tested)!$' input-15.txt > output.txt 2> stderr.txt
+echo "Test 15: ./regular $FLAGS '^Your (license|application|program) has been (revoked|accepted|tested)!$' input-15.txt > output.txt 2> stderr.txt"
+./regular $FLAGS '^Your (license|application|program) has been (revoked|accepted|tested)!$' input-15.txt > output.txt 2> stderr.txt
 STATUS=$?
 checkResults 15 0
 
@@ -102,18 +106,18 @@ runTest 16 '[0123456789]+[.][0123456789]+' 0
 runTest 17 '*' 1
 runTest 18 'abc[123' 1
 
-echo "Test 19: ./regular 'abc' not-a-file.txt > output.txt 2> stderr.txt"
-./regular 'abc' not-a-file.txt > output.txt 2> stderr.txt
+echo "Test 19: ./regular $FLAGS 'abc' not-a-file.txt > output.txt 2> stderr.txt"
+./regular $FLAGS 'abc' not-a-file.txt > output.txt 2> stderr.txt
 STATUS=$?
 checkResults 19 1
 
 # Bad command-line arguments
-echo "Test 20: ./regular too many arguments > output.txt 2> stderr.txt"
-./regular too many arguments > output.txt 2> stderr.txt
+echo "Test 20: ./regular $FLAGS too many arguments > output.txt 2> stderr.txt"
+./regular $FLAGS too many arguments > output.txt 2> stderr.txt
 STATUS=$?
 checkResults 20 1
 
-runTest 21 'this|that' 1
+runTest 21 'this|that' 0
 
 if [ $FAIL -ne 0 ]; then
   echo "FAILING TESTS!"